@@ -1,23 +1,26 @@
 #pragma once
 
 #include "Utils/Allpass.h"
+#include "Utils/CoefficientTable.h"
+#include "Utils/FirstOrderFilter.h"
+#include "Utils/Modulation.h"
+#include "Utils/TaskPool.h"
 
 namespace AudioProcessorBlock
 {
+    // Three all passes in series, the last one modulated, into a low pass.
     class BasicVerb
     {
     private:
-        Utils::AllPass ap1, ap2, apMod, apFeedback;
+        Utils::AllPass ap1, ap2, apMod;
 
-        std::vector<juce::dsp::IIR::Filter<float>> outputLowPass;
-        juce::dsp::IIR::Coefficients<float>::Ptr outputFilterCoefficients;
+        Utils::FirstOrderFilter outputLowPass;
+        Utils::FirstOrderTable lowPassTable;
 
-        std::vector<juce::dsp::IIR::Filter<float>> dampingLowPass;
-        juce::dsp::IIR::Coefficients<float>::Ptr dampingFilterCoefficients;
+        double sampleRate{ 44100.0 };
+        float decay{ 0.f }, damp{ 20000.f };
 
-        double sampleRate;
-        float decay, damp, feedback;
-        juce::AudioBuffer<float> previousBuffer;
+        void processPair(juce::AudioSampleBuffer &buffer, int pair, const float* modulation);
 
     public:
         BasicVerb()
@@ -26,115 +29,102 @@ namespace AudioProcessorBlock
         ~BasicVerb()
         {};
 
-        void prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate);
-        void process(juce::AudioSampleBuffer &buffer);
-        void updateParams(float _decay, float _damp, float modRate, float modAmount);
+        void prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate, float maxDecay, float maxModulationInSamples);
+        void registerDelayMemory(Utils::DelayArena& arena, Utils::Stage stage);
+        void process(juce::AudioSampleBuffer &buffer, const Utils::Modulation& modulation, Utils::TaskPool& pool);
+        void reset();
+        float getTailInSamples(float threshold) const;
+        void updateParams(float _decay, float _damp, float modAmount);
+        void setQuality(Utils::Quality quality);
     };
 
-    inline void BasicVerb::prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate)
+    // maxDecay is the largest value updateParams() will be given, in samples.
+    inline void BasicVerb::prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate, float maxDecay, float maxModulationInSamples)
     {
         sampleRate = _sampleRate;
 
-        // Prepare all pass filters
-        ap1.prepare(spec, sampleRate, 6500);
-        ap2.prepare(spec, sampleRate, 6500);
-        apMod.prepare(spec, sampleRate, 6500);
+        // Prepare all pass filters, sized for the delay ratios in updateParams()
+        ap1.prepare(spec, sampleRate, static_cast<int>(std::ceil(maxDecay)));
+        ap2.prepare(spec, sampleRate, static_cast<int>(std::ceil(maxDecay * 1.39f)));
+        apMod.prepare(spec, sampleRate, static_cast<int>(std::ceil(maxDecay * 1.93f + maxModulationInSamples)));
         apMod.setModulation(true);
-        apFeedback.prepare(spec, sampleRate, 6500);
 
-        // Prepare low pass filters
-        outputLowPass.resize(spec.numChannels);
-        for(auto& f : outputLowPass)
-        {
-            f.prepare(spec);
-            f.reset();
-        }
-        outputFilterCoefficients = *juce::dsp::IIR::Coefficients<float>::makeFirstOrderLowPass(sampleRate, 20000.f);
+        // Prepare low pass filter
+        Utils::prepareFirstOrderLowPass(lowPassTable, sampleRate);
 
-        dampingLowPass.resize(spec.numChannels);
-        for(auto& f: dampingLowPass)
-        {
-            f.prepare(spec);
-            f.reset();
-        }
-        dampingFilterCoefficients = *juce::dsp::IIR::Coefficients<float>::makeFirstOrderLowPass(sampleRate, 20000.f);
+        outputLowPass.prepare(static_cast<int>(spec.numChannels));
+        outputLowPass.setCoefficients(lowPassTable.lookup(damp));
     }
 
-    inline void BasicVerb::process(juce::AudioSampleBuffer &buffer)
+    inline void BasicVerb::registerDelayMemory(Utils::DelayArena& arena, Utils::Stage stage)
     {
-        int numChannels = buffer.getNumChannels();
-        for (int channel = 0; channel < numChannels; ++channel)
+        ap1.registerDelayMemory(arena, stage);
+        ap2.registerDelayMemory(arena, stage);
+        apMod.registerDelayMemory(arena, stage);
+    }
+
+    // modulation is one block of the shared diffuser LFO, read by apMod.
+    // Every stage runs the channels in pairs, see Utils::StereoFrame, and no
+    // stage mixes pairs, so each pair is one task.
+    inline void BasicVerb::process(juce::AudioSampleBuffer &buffer, const Utils::Modulation& modulation, Utils::TaskPool& pool)
+    {
+        pool.run(Utils::getNumChannelPairs(buffer.getNumChannels()), [&] (int pair)
         {
-            if (previousBuffer.getNumSamples() > 0)
-            {
-                buffer.addFromWithRamp(
-                    channel, 
-                    0, 
-                    previousBuffer.getReadPointer(channel),
-                    buffer.getNumSamples(),
-                    feedback,
-                    feedback
-                );
-            }
-
-            // Serial all pass filter stage
-            ap1.process(buffer, channel);
-            ap2.process(buffer, channel);
-
-            // Feedback all pass filter stage
-            previousBuffer.copyFrom(
-                channel,
-                0,
-                buffer.getReadPointer(channel),
-                previousBuffer.getNumSamples()
-            );
-            apFeedback.process(previousBuffer, channel);
-
-            auto* pbWriteHead = previousBuffer.getWritePointer(channel);
-            auto* pbReadHead = previousBuffer.getReadPointer(channel);
-            for (int s = 0; s < previousBuffer.getNumSamples(); ++s)
-            {
-                auto sample = dampingLowPass[channel].processSample(pbReadHead[s]);
-                pbWriteHead[s] = static_cast<float>(std::tanh(-sample));
-            }
-
-            // Process output stage
-            apMod.process(buffer, channel);
-
-            auto* outWriteHead = buffer.getWritePointer(channel);
-            auto* outReadHead = buffer.getReadPointer(channel);
-            for (int s = 0; s < buffer.getNumSamples(); ++s)
-                outWriteHead[s] = outputLowPass[channel].processSample(outReadHead[s]);
-        }
+            processPair(buffer, pair, modulation.forPair(pair));
+        });
+    }
+
+    inline void BasicVerb::processPair(juce::AudioSampleBuffer &buffer, int pair, const float* modulation)
+    {
+        // Serial all pass filter stage
+        ap1.processPair(buffer, pair, nullptr);
+        ap2.processPair(buffer, pair, nullptr);
+
+        // Process output stage
+        apMod.processPair(buffer, pair, modulation);
+        outputLowPass.processPair(buffer, pair);
+    }
+
+    inline void BasicVerb::reset()
+    {
+        ap1.reset();
+        ap2.reset();
+        apMod.reset();
+        outputLowPass.reset();
     }
 
-    inline void BasicVerb::updateParams(float _decay, float _damp, float modRate, float modAmount)
+    // The all pass filters run in series, so their rings add up.
+    inline float BasicVerb::getTailInSamples(float threshold) const
+    {
+        return ap1.getTailInSamples(threshold)
+             + ap2.getTailInSamples(threshold)
+             + apMod.getTailInSamples(threshold);
+    }
+
+    inline void BasicVerb::updateParams(float _decay, float _damp, float modAmount)
     {
         if (_decay != decay)
         {  
             decay = _decay;
-            feedback = decay / 4000.f;
 
             ap1.setAPSampleDelay(decay);
             ap2.setAPSampleDelay(decay * 1.39f);
             apMod.setAPSampleDelay(decay * 1.93f);
-            apFeedback.setAPSampleDelay(decay * 2.f);
-            apFeedback.setFeedback(.6f);
         }
         
         if (_damp != damp)
         {
             damp = _damp;
-            outputFilterCoefficients = juce::dsp::IIR::Coefficients<float>::makeFirstOrderLowPass(sampleRate, _damp);
-            for (auto& f : outputLowPass)
-                f.coefficients = outputFilterCoefficients;
-
-            dampingFilterCoefficients = juce::dsp::IIR::Coefficients<float>::makeFirstOrderLowPass(sampleRate, _damp / 1.4f);
-            for (auto& f : dampingLowPass)
-                f.coefficients = dampingFilterCoefficients;
+            outputLowPass.setCoefficients(lowPassTable.lookup(_damp));
         }
 
         apMod.setModAmount(modAmount);
-        apMod.setModFreq(modRate);
     }
-}
\ No newline at end of file
+
+    inline void BasicVerb::setQuality(Utils::Quality quality)
+    {
+        ap1.setQuality(quality);
+        ap2.setQuality(quality);
+        apMod.setQuality(quality);
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "Utils/ImpulseResponse.h"
+#include "Utils/StatePublisher.h"
+
+#include <juce_dsp/juce_dsp.h>
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <atomic>
+#include <memory>
+
+namespace AudioProcessorBlock
+{
+    // Convolution with an impulse response file, as a third diffuser. Files
+    // are read and transformed by a Utils::StateBuilder, whose worker thread
+    // is shared by every instance, and the finished engine reaches the audio
+    // thread through its publisher, so the audio thread never allocates,
+    // frees or waits.
+    class ConvolutionVerb
+    {
+    public:
+        static constexpr int partitionSize = 256;
+
+        ConvolutionVerb()
+        {};
+
+        ~ConvolutionVerb()
+        {};
+
+        // Not for the audio thread. Rebuilds the engine for the new channel
+        // count and rate straight away, as nothing is playing; the response
+        // is resampled when the rate is new.
+        void prepare(const juce::dsp::ProcessSpec &spec)
+        {
+            numChannels = static_cast<int>(spec.numChannels);
+            sampleRate = spec.sampleRate;
+            builder.rebuildNow(getLayout());
+        };
+
+        // Starts loading file in the background. Each build loads the newest
+        // request, so a burst of requests ends on the last file.
+        void loadImpulseResponse(const juce::File& file)
+        {
+            {
+                const juce::ScopedLock lock(requestLock);
+                requestedFile = file;
+            }
+
+            builder.request(getLayout());
+        };
+
+        juce::File getImpulseResponseFile() const
+        {
+            const juce::ScopedLock lock(requestLock);
+            return requestedFile;
+        };
+
+        //== Audio thread ======================================================
+        // Takes over a newly loaded engine. Returns true when it changed.
+        bool update() { return builder.update(); };
+
+        bool hasImpulseResponse() const { return builder.get() != nullptr; };
+
+        // Wet only: the buffer is replaced by its convolution, or by silence
+        // while no response is loaded.
+        void process(juce::AudioBuffer<float>& buffer)
+        {
+            if (auto* engine = builder.get())
+                engine->process(buffer);
+            else
+                buffer.clear();
+        };
+
+        void reset()
+        {
+            if (auto* engine = builder.get())
+                engine->reset();
+        };
+
+        float getTailInSamples() const
+        {
+            auto* engine = builder.get();
+            return engine != nullptr ? static_cast<float>(engine->getLength()) : 0.f;
+        };
+
+    private:
+        // What an engine is built for.
+        struct Layout
+        {
+            int numChannels;
+            double sampleRate;
+        };
+
+        Layout getLayout() const { return { numChannels.load(), sampleRate.load() }; };
+
+        // Runs on the builder's worker, or in prepare(). A file that fails to
+        // load leaves the last response playing, as long as it was made for
+        // the same rate.
+        std::unique_ptr<Utils::ConvolutionEngine> build(const Layout& layout)
+        {
+            if (auto loaded = Utils::ImpulseResponse::load(getImpulseResponseFile(), partitionSize, layout.sampleRate))
+                response = loaded;
+            else if (response != nullptr && response->getSampleRate() != layout.sampleRate)
+                response = nullptr;
+
+            if (response == nullptr)
+                return nullptr;
+
+            return std::make_unique<Utils::ConvolutionEngine>(response, layout.numChannels);
+        };
+
+        juce::CriticalSection requestLock;
+        juce::File requestedFile;
+        std::atomic<int> numChannels{ 2 };
+        std::atomic<double> sampleRate{ 44100.0 };
+
+        // Only touched by builds, which never overlap
+        std::shared_ptr<const Utils::ImpulseResponse> response;
+
+        // Last, so it stops building before the rest goes away
+        Utils::StateBuilder<Layout, Utils::ConvolutionEngine> builder{ [this] (const Layout& layout) { return build(layout); } };
+    };
+}
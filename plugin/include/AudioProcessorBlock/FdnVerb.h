@@ -0,0 +1,284 @@
+#pragma once
+
+#include "Utils/CoefficientTable.h"
+#include "Utils/DelayArena.h"
+#include "Utils/Dispatch.h"
+#include "Utils/FastMath.h"
+#include "Utils/Modulation.h"
+#include "Utils/StereoFrame.h"
+#include "Utils/TaskPool.h"
+
+#include <juce_dsp/juce_dsp.h>
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <array>
+#include <vector>
+
+namespace AudioProcessorBlock
+{
+    // Feedback delay network reverb, the denser alternative to the two
+    // BasicVerb stages. Every channel pair drives its own network of eight
+    // delay lines. Each sample, the lines are read, scaled by their own
+    // decay gain, low passed by their own damping and mixed back through a
+    // Householder reflection, which feeds every line into every other one
+    // without losing energy. All eight lines live side by side in SIMD
+    // registers, so everything but the reads runs a register at a time.
+    class FdnVerb
+    {
+    public:
+        static constexpr int numLines = Utils::NetworkRingBuffer::numLines;
+
+        FdnVerb()
+        {};
+
+        ~FdnVerb()
+        {};
+
+        void prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate, float maxSize, float maxModulationInSamples);
+        void registerDelayMemory(Utils::DelayArena& arena, Utils::Stage stage);
+        void process(juce::AudioSampleBuffer &buffer, const Utils::Modulation& modulation, Utils::TaskPool& pool);
+        void reset();
+        float getTailInSamples(float threshold) const;
+
+        // The longest line is _size samples, and decaySeconds is the time the
+        // tail takes to fall by 60 dB.
+        void updateParams(float _size, float decaySeconds, float _damp, float modAmount);
+
+    private:
+        static constexpr auto registerWidth = static_cast<int>(Utils::FloatRegister::SIMDNumElements);
+        static_assert(numLines % registerWidth == 0, "The lines have to fill whole registers");
+        static constexpr int numRegisters = numLines / registerWidth;
+
+        using LineVector = std::array<Utils::FloatRegister, static_cast<size_t>(numRegisters)>;
+        using LineArray = std::array<float, static_cast<size_t>(numLines)>;
+
+        // Line lengths relative to the longest, spread so no two share a
+        // common period for long.
+        static constexpr LineArray lengthRatios{ 1.f, .911f, .823f, .761f, .683f, .617f, .557f, .503f };
+
+        // Which lines each input feeds and each output hears, with signs so
+        // left and right come out decorrelated.
+        static constexpr LineArray leftInput{ .5f, 0.f, -.5f, 0.f, .5f, 0.f, -.5f, 0.f };
+        static constexpr LineArray rightInput{ 0.f, .5f, 0.f, -.5f, 0.f, .5f, 0.f, -.5f };
+        static constexpr LineArray leftOutput{ .35f, .35f, -.35f, -.35f, .35f, .35f, -.35f, -.35f };
+        static constexpr LineArray rightOutput{ .35f, -.35f, -.35f, .35f, .35f, -.35f, -.35f, .35f };
+
+        // Share of the modulation depth each line swings by.
+        static constexpr LineArray modulationSpread{ 1.f, -1.f, .7f, -.7f, .5f, -.5f, .3f, -.3f };
+
+        struct Network
+        {
+            Utils::NetworkRingBuffer lines;
+            LineVector damping;
+        };
+
+        template <bool Modulated, bool Stereo>
+        void processFrames(const Utils::ChannelPair& channels, Network& network, const float* modulation, int numSamples);
+        void processPair(juce::AudioSampleBuffer &buffer, int pair, const float* modulation);
+
+        static LineVector load(const LineArray& values)
+        {
+            LineVector vector;
+            for (int r = 0; r < numRegisters; ++r)
+                vector[static_cast<size_t>(r)] = Utils::FloatRegister::fromRawArray(values.data() + r * registerWidth);
+
+            return vector;
+        };
+
+        std::vector<Network> networks;
+        Utils::CoefficientTable<1> poleTable;
+
+        // The per-line constants, as registers for the sample loop
+        alignas(64) LineArray delays{}, modulationDepths{};
+        LineVector gains{}, dampingPole{}, leftIn{}, rightIn{}, leftOut{}, rightOut{};
+        std::array<int, static_cast<size_t>(numLines)> wholeDelays{};
+
+        double sampleRate{ 44100.0 };
+        float size{ 0.f }, decay{ 0.f }, damp{ 20000.f }, modulationAmount{ 0.f };
+    };
+
+    // maxSize and maxModulationInSamples are the largest values updateParams()
+    // will be given.
+    inline void FdnVerb::prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate, float maxSize, float maxModulationInSamples)
+    {
+        sampleRate = _sampleRate;
+
+        networks.resize(static_cast<size_t>(Utils::getNumChannelPairs(static_cast<int>(spec.numChannels))));
+        for (auto& n : networks)
+            n.lines.prepare(static_cast<int>(std::ceil(maxSize + maxModulationInSamples)) + 1);
+
+        poleTable.prepare(sampleRate, [this] (float freq) {
+            return std::array<float, 1>{ static_cast<float>(std::exp(-juce::MathConstants<double>::twoPi * freq / sampleRate)) };
+        });
+
+        // The constant tables are not register aligned, so go through a copy
+        alignas(64) LineArray aligned;
+        auto toRegisters = [&aligned] (const LineArray& values) {
+            aligned = values;
+            return load(aligned);
+        };
+
+        leftIn = toRegisters(leftInput);
+        rightIn = toRegisters(rightInput);
+        leftOut = toRegisters(leftOutput);
+        rightOut = toRegisters(rightOutput);
+
+        // Force every setting through on the next updateParams()
+        size = decay = damp = modulationAmount = -1.f;
+        reset();
+    }
+
+    inline void FdnVerb::registerDelayMemory(Utils::DelayArena& arena, Utils::Stage stage)
+    {
+        for (auto& n : networks)
+            arena.add(stage, n.lines);
+    }
+
+    // modulation is one block of the shared diffuser LFO. Networks share no
+    // state, so each pair is one task.
+    inline void FdnVerb::process(juce::AudioSampleBuffer &buffer, const Utils::Modulation& modulation, Utils::TaskPool& pool)
+    {
+        pool.run(Utils::getNumChannelPairs(buffer.getNumChannels()), [&] (int pair)
+        {
+            processPair(buffer, pair, modulation.forPair(pair));
+        });
+    }
+
+    inline void FdnVerb::processPair(juce::AudioSampleBuffer &buffer, int pair, const float* modulation)
+    {
+        auto channels = Utils::getChannelPair(buffer, pair);
+        auto& network = networks[static_cast<size_t>(pair)];
+        auto numSamples = buffer.getNumSamples();
+
+        Utils::withFlag(modulation != nullptr && modulationAmount > 0.f, [&] (auto modulated) {
+            Utils::withPairLayout(channels, [&] (auto stereo) {
+                processFrames<decltype(modulated)::value, decltype(stereo)::value>(channels, network, modulation, numSamples);
+            });
+        });
+    }
+
+    template <bool Modulated, bool Stereo>
+    void FdnVerb::processFrames(const Utils::ChannelPair& channels, Network& network, const float* modulation, int numSamples)
+    {
+        using Register = Utils::FloatRegister;
+        constexpr auto reflection = 2.f / static_cast<float>(numLines);
+
+        alignas(64) LineArray taps;
+
+        for (int s = 0; s < numSamples; ++s)
+        {
+            // The only per-line scalar work: each line is read at its own delay
+            if constexpr (Modulated)
+            {
+                for (int i = 0; i < numLines; ++i)
+                    taps[static_cast<size_t>(i)] = network.lines.readInterpolated(
+                        i, delays[static_cast<size_t>(i)] + modulation[s] * modulationDepths[static_cast<size_t>(i)]);
+            }
+            else
+            {
+                for (int i = 0; i < numLines; ++i)
+                    taps[static_cast<size_t>(i)] = network.lines.read(i, wholeDelays[static_cast<size_t>(i)]);
+            }
+
+            auto input = channels.read<Stereo>(s);
+            auto inLeft = Register::expand(input.left());
+            auto inRight = Register::expand(input.right());
+
+            // Decay, then damping: z = x + pole * (z - x)
+            LineVector state;
+            auto total = Register::expand(0.f), outLeft = total, outRight = total;
+            for (size_t r = 0; r < static_cast<size_t>(numRegisters); ++r)
+            {
+                auto x = Register::fromRawArray(taps.data() + r * static_cast<size_t>(registerWidth)) * gains[r];
+                network.damping[r] = x + dampingPole[r] * (network.damping[r] - x);
+
+                state[r] = network.damping[r];
+                total += state[r];
+                outLeft += state[r] * leftOut[r];
+                outRight += state[r] * rightOut[r];
+            }
+
+            // Householder reflection, I - 2/N * ones: every line gets the
+            // mean of the others, and the matrix is orthogonal, so the only
+            // loss is the decay gain
+            auto mix = Register::expand(total.sum() * reflection);
+            auto* frame = network.lines.getWriteFrame();
+            for (size_t r = 0; r < static_cast<size_t>(numRegisters); ++r)
+                (state[r] - mix + inLeft * leftIn[r] + inRight * rightIn[r]).copyToRawArray(frame + r * static_cast<size_t>(registerWidth));
+
+            network.lines.advance();
+            channels.write<Stereo>(s, Utils::StereoFrame::make(outLeft.sum(), outRight.sum()));
+        }
+    }
+
+    inline void FdnVerb::reset()
+    {
+        for (auto& n : networks)
+        {
+            n.lines.reset();
+            for (auto& d : n.damping)
+                d = Utils::FloatRegister::expand(0.f);
+        }
+    }
+
+    // Samples until an impulse has fallen below threshold: the time to
+    // decay by that much, plus the longest line and its modulation.
+    inline float FdnVerb::getTailInSamples(float threshold) const
+    {
+        if (decay <= 0.f)
+            return 0.f;
+
+        auto decayDb = -20.f * std::log10(threshold);
+        return decay * static_cast<float>(sampleRate) * decayDb / 60.f + size + std::abs(modulationAmount);
+    }
+
+    inline void FdnVerb::updateParams(float _size, float decaySeconds, float _damp, float modAmount)
+    {
+        alignas(64) LineArray values;
+
+        if (_size != size || decaySeconds != decay)
+        {
+            size = _size;
+            decay = decaySeconds;
+
+            // Each line loses 60 dB per decay time, whatever its length, so
+            // they all fade together
+            auto decaySamples = juce::jmax(1.f, decay * static_cast<float>(sampleRate));
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                auto length = juce::jmax(1, juce::roundToInt(size * lengthRatios[i]));
+                wholeDelays[i] = length;
+                delays[i] = static_cast<float>(length);
+                values[i] = std::pow(10.f, -3.f * static_cast<float>(length) / decaySamples);
+            }
+
+            gains = load(values);
+        }
+
+        // The longest line gets the damping cutoff. A shorter line goes round
+        // more often, so it takes less off per trip: its loss at Nyquist, in
+        // dB, is the longest line's scaled by its length, as its decay gain
+        // is. Every line then dulls at the same rate, like it fades at the
+        // same rate.
+        if (_damp != damp)
+        {
+            damp = _damp;
+            auto pole = poleTable.lookup(damp)[0];
+            auto nyquistGain = (1.f - pole) / (1.f + pole);
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                auto lineGain = std::pow(nyquistGain, lengthRatios[i]);
+                values[i] = (1.f - lineGain) / (1.f + lineGain);
+            }
+
+            dampingPole = load(values);
+        }
+
+        if (modAmount != modulationAmount)
+        {
+            modulationAmount = modAmount;
+            for (size_t i = 0; i < values.size(); ++i)
+                modulationDepths[i] = modulationSpread[i] * modulationAmount;
+        }
+    }
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "Utils/CoefficientTable.h"
+#include "Utils/FirstOrderFilter.h"
+#include "Utils/Quality.h"
 #include "Utils/Saturator.h"
 
 #include <juce_dsp/juce_dsp.h>
@@ -12,10 +15,12 @@ namespace AudioProcessorBlock
     private:
         double sampleRate{ 44100.f }; 
         float saturation{ 1.f }, gain{ 1.f }, tone{ 20000.f };
-        juce::dsp::ProcessorDuplicator<juce::dsp::IIR::Filter<float>, juce::dsp::IIR::Coefficients<float>> toneFilter;
+        bool useFastMath{ false };
+        Utils::FirstOrderFilter toneFilter;
+        Utils::FirstOrderTable toneTable;
 
     public:
-        Preamp() : toneFilter(juce::dsp::IIR::Coefficients<float>::makeFirstOrderLowPass(44100, 20000.f))
+        Preamp()
         {};
 
         ~Preamp()
@@ -24,8 +29,14 @@ namespace AudioProcessorBlock
         void prepare(juce::dsp::ProcessSpec& spec)
         {
             sampleRate = spec.sampleRate;
+            toneFilter.prepare(static_cast<int>(spec.numChannels));
+            Utils::prepareFirstOrderLowPass(toneTable, sampleRate);
+            toneFilter.setCoefficients(toneTable.lookup(tone));
+        };
+
+        void reset()
+        {
             toneFilter.reset();
-            toneFilter.prepare(spec);
         };
 
         void process(juce::AudioBuffer<float>& buffer)
@@ -36,12 +47,19 @@ namespace AudioProcessorBlock
             for (int channel = 0; channel < channels; ++channel)
             {
                 auto channelData = buffer.getWritePointer(channel);
-                for (int sample = 0; sample < numSamples; ++sample)
-                    channelData[sample] = static_cast<float>(Utils::saturate(channelData[sample] * saturation));
+
+                if (useFastMath)
+                {
+                    Utils::saturateBlock(channelData, channelData, numSamples, saturation);
+                }
+                else
+                {
+                    for (int sample = 0; sample < numSamples; ++sample)
+                        channelData[sample] = static_cast<float>(Utils::saturate(channelData[sample] * saturation));
+                }
             }
 
-            juce::dsp::AudioBlock<float> block(buffer);
-            toneFilter.process(juce::dsp::ProcessContextReplacing<float>(block));
+            toneFilter.process(buffer);
             buffer.applyGain(gain);
         };
 
@@ -57,12 +75,17 @@ namespace AudioProcessorBlock
                 gain = outGain;
         };
 
+        void setQuality(Utils::Quality quality)
+        {
+            useFastMath = Utils::QualitySettings::forTier(quality).fastMath;
+        };
+
         void setToneFrequency(float freq)
         {
             if (freq != tone)
             {
                 tone = freq;
-                *toneFilter.state = *juce::dsp::IIR::Coefficients<float>::makeFirstOrderLowPass(sampleRate, tone);
+                toneFilter.setCoefficients(toneTable.lookup(tone));
             }
         };
     };
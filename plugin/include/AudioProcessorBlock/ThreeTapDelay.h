@@ -1,34 +1,76 @@
 #pragma once
 
-#include "Utils/Delay.h"
+#include <juce_dsp/juce_dsp.h>
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include "Utils/DampingFilter.h"
+#include "Utils/DelayArena.h"
+#include "Utils/Dispatch.h"
+#include "Utils/FastMath.h"
+#include "Utils/Modulation.h"
+#include "Utils/Quality.h"
+#include "Utils/RingBuffer.h"
+#include "Utils/TaskPool.h"
 
 namespace AudioProcessorBlock
 {
+    // A multi-tap delay. The dry input goes into one line per channel pair,
+    // written a block at a time and read by every tap. Each tap recirculates
+    // through a lane of its own, which only holds its saturated and damped
+    // feedback, so a tap reads the dry line plus its lane and sounds as it
+    // would on a line of its own: only taps with feedback on repeat, and
+    // only their own echoes. Each tap's volume and pan are applied as it is
+    // read. Once the dry lines hold the block, every tap of every pair is a
+    // task of its own, writing to its own output, and the outputs are
+    // summed in tap order, so threading does not change the result.
     class ThreeTapDelay
     {
     private:
-        std::vector<juce::dsp::Panner<float>> tapPan;
-        std::vector<juce::AudioBuffer<float>> tapBuffer;
+        double sampleRate{ 44100.0 };
+        int numPairs{ 1 };
+
+        // dryLine per pair; feedbackLane and the damping filter's state per
+        // tap and pair, at t * numPairs + pair.
+        std::vector<Utils::StereoRingBuffer> dryLine, feedbackLane;
+        Utils::DampingFilter damping;
+
+        // What each tap of each pair adds to the output, one channel pair per
+        // lane, in the same order.
+        juce::AudioBuffer<float> tapOutput;
+        Utils::Quality quality{ Utils::Quality::high };
+        Utils::QualitySettings settings{ Utils::QualitySettings::forTier(Utils::Quality::high) };
+
+        // Per tap, worked out by updateTaps() whenever a parameter moves.
+        // Only the first numActiveTaps are mixed in, so only they are read.
+        std::vector<float> tapTime, tapVolume, tapFeedbackGain;
+        std::vector<Utils::StereoFrame> tapGain;
+        std::vector<bool> tapFeedback;
+        int numberOfTaps{ 3 }, numActiveTaps{ 0 };
 
-        std::vector<std::unique_ptr<Utils::Delay>> tap;
-        std::vector<float> tapVolume;
-        int numberOfTaps{ 3 };
         float delayTime{ 1.f }, delaySpread{ 0.f }, delayPanWidth{ 0.f }, delayTaps{ 0.f }, delayFeedback{ 0.f };
-        float modFrequency{ 0.f }, modAmount{ 0.f }, tapDamping{ 20000.f };
-        bool tap1Feedback{ false }, tap2Feedback{ false }, tap3Feedback{ false };
+        float modAmount{ 0.f }, tapDamping{ 20000.f };
+
+        void updateTaps();
+
+        template <Utils::Quality Tier, bool Modulated, bool Stereo>
+        void processFrames(const Utils::ChannelPair& output, int tap, int pair, const float* modulation, int numSamples);
 
     public:
         ThreeTapDelay()
         {};
 
-        ThreeTapDelay(int numOfTaps) 
+        ThreeTapDelay(int numOfTaps)
         {numberOfTaps = numOfTaps;};
 
         ~ThreeTapDelay()
         {};
 
-        void prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate);
-        void process(juce::AudioBuffer<float>& buffer);
+        void prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate, float maxTimeInMs, float maxSpreadInMs, float maxModulationInSamples);
+        void registerDelayMemory(Utils::DelayArena& arena);
+        void process(juce::AudioBuffer<float>& buffer, const Utils::Modulation& modulation, Utils::TaskPool& pool);
+        void reset();
+        int getMaxTasks(int numChannels) const;
+        float getTailInSamples(float threshold) const;
 
         void setDelayTime(float time);
         void setDelaySpread(float spread);
@@ -36,92 +78,209 @@ namespace AudioProcessorBlock
         void setDelayTaps(float taps);
         void setDelayFeedback(float feedback);
         void setTapsFeeback(bool t1Feedback, bool t2Feedback, bool t3Feeback);
-        void setTapsModulation(float freq, float amount);
+        void setTapsModulation(float amount);
         void setTapsDamping(float freq);
+        void setQuality(Utils::Quality quality);
     };
-    
+
     //========================================================================================
-    inline void ThreeTapDelay::prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate)
+    inline void ThreeTapDelay::prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate, float maxTimeInMs, float maxSpreadInMs, float maxModulationInSamples)
+    {
+        sampleRate = _sampleRate;
+
+        // Tap i sits at time + i * spread, so the lines only need room for the last one
+        auto maxTapInMs = maxTimeInMs + static_cast<float>(numberOfTaps - 1) * maxSpreadInMs;
+        auto maxDelayInSamples = static_cast<int>(std::ceil(static_cast<float>(sampleRate) * maxTapInMs * .001f + maxModulationInSamples));
+
+        numPairs = Utils::getNumChannelPairs(static_cast<int>(spec.numChannels));
+        dryLine.resize(static_cast<size_t>(numPairs));
+        feedbackLane.resize(static_cast<size_t>(numberOfTaps * numPairs));
+        for(auto& l : dryLine)
+            l.prepare(maxDelayInSamples, static_cast<int>(spec.maximumBlockSize));
+        for(auto& l : feedbackLane)
+            l.prepare(maxDelayInSamples);
+
+        tapOutput.setSize(2 * numberOfTaps * numPairs, static_cast<int>(spec.maximumBlockSize));
+        tapOutput.clear();
+
+        // One filter state per lane
+        damping.prepare(2 * numberOfTaps * numPairs, sampleRate);
+        damping.setCutoff(tapDamping);
+        damping.setOrder(settings.dampingFilterOrder);
+
+        auto numTaps = static_cast<size_t>(numberOfTaps);
+        tapTime.resize(numTaps);
+        tapVolume.resize(numTaps);
+        tapFeedbackGain.resize(numTaps);
+        tapGain.resize(numTaps);
+        tapFeedback.resize(numTaps);
+
+        updateTaps();
+    }
+
+    inline void ThreeTapDelay::registerDelayMemory(Utils::DelayArena& arena)
+    {
+        for(auto& l : dryLine)
+            arena.add(Utils::Stage::tapsDelay, l);
+        for(auto& l : feedbackLane)
+            arena.add(Utils::Stage::tapsDelay, l);
+    }
+
+    // modulation is one block of the shared taps LFO per channel pair, read
+    // by every tap.
+    inline void ThreeTapDelay::process(juce::AudioBuffer<float>& buffer, const Utils::Modulation& modulation, Utils::TaskPool& pool)
     {
-        tap.resize(numberOfTaps);
-        for(auto& t : tap)
+        int numSamples = buffer.getNumSamples();
+        int pairs = Utils::getNumChannelPairs(buffer.getNumChannels());
+
+        // The taps only read the dry lines, so the whole block goes in first
+        for (int pair = 0; pair < pairs; ++pair)
         {
-            auto tapPtr = std::make_unique<Utils::Delay>();
-            t = std::move(tapPtr);
-            t->prepare(spec, _sampleRate, 3500.f);
+            auto channels = Utils::getChannelPair(buffer, pair);
+            Utils::withPairLayout(channels, [&] (auto stereo) {
+                dryLine[static_cast<size_t>(pair)].pushBlock<decltype(stereo)::value>(channels, numSamples);
+            });
         }
 
-        tapPan.resize(numberOfTaps);
-        for(auto& tp : tapPan)
+        // Every tap of every pair has its own lane, filter state and output
+        auto* const* tapChannels = tapOutput.getArrayOfWritePointers();
+        pool.run(numActiveTaps * pairs, [&] (int task)
         {
-            tp.reset();
-            tp.prepare(spec);
-            tp.setRule(juce::dsp::PannerRule::balanced);
-            tp.setPan(0.f);
-        }
+            auto tap = task / pairs, pair = task % pairs;
+            auto lane = tap * numPairs + pair;
+            auto stereo = 2 * pair + 1 < buffer.getNumChannels();
+            Utils::ChannelPair output{ tapChannels[2 * lane], stereo ? tapChannels[2 * lane + 1] : nullptr };
+            auto* pairModulation = modulation.forPair(pair);
+
+            Utils::withQuality(quality, [&] (auto tier) {
+                Utils::withFlag(pairModulation != nullptr && modAmount > 0, [&] (auto modulated) {
+                    Utils::withPairLayout(output, [&] (auto isStereo) {
+                        processFrames<decltype(tier)::value, decltype(modulated)::value, decltype(isStereo)::value>(
+                            output, tap, pair, pairModulation, numSamples);
+                    });
+                });
+            });
+        });
+
+        // Summed in tap order, whichever thread rendered which tap
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            auto pair = channel / 2, side = channel % 2;
+            if (numActiveTaps == 0)
+            {
+                buffer.clear(channel, 0, numSamples);
+                continue;
+            }
 
-        tapBuffer.resize(numberOfTaps);
-        tapVolume.resize(numberOfTaps);
+            buffer.copyFrom(channel, 0, tapOutput, 2 * pair + side, 0, numSamples);
+            for (int tap = 1; tap < numActiveTaps; ++tap)
+                buffer.addFrom(channel, 0, tapOutput, 2 * (tap * numPairs + pair) + side, 0, numSamples);
+        }
     }
 
-    inline void ThreeTapDelay::process(juce::AudioBuffer<float>& buffer)
+    // The per-sample loop of one tap, one instantiation per tier, modulation
+    // and pair layout. The tap reads its feedback lane before writing it, so
+    // it can be as short as the read kernel allows. A tap with feedback off
+    // still feeds its lane, with silence, so the lane empties rather than
+    // holding on to old repeats.
+    template <Utils::Quality Tier, bool Modulated, bool Stereo>
+    void ThreeTapDelay::processFrames(const Utils::ChannelPair& output, int tap, int pair, const float* modulation, int numSamples)
     {
-        int channels = buffer.getNumChannels();
-        int numSamples = buffer.getNumSamples();
+        constexpr auto tierSettings = Utils::QualitySettings::forTier(Tier);
+        auto t = static_cast<size_t>(tap);
+        auto lane = tap * numPairs + pair;
+        auto& line = dryLine[static_cast<size_t>(pair)];
+        auto& feedbackLine = feedbackLane[static_cast<size_t>(lane)];
 
-        // Copy input to each tap buffer
-        for(auto& b : tapBuffer) 
-            b.makeCopyOf(buffer);
-        
-        // Process delay taps
-        for(int i = 0; i < 3; ++i)
+        for (int s = 0; s < numSamples; ++s)
         {
-            for(int ch = 0; ch < channels; ++ch)
-            {
-                if (tapVolume[i] > 0)
-                    tap[i]->process(tapBuffer[i], ch);
-            }
+            float m = .0f;
+            if constexpr (Modulated)
+                m = (modulation[s] + 1) * modAmount;
+
+            auto delayedFrame = line.popBlockFrame<tierSettings.interpolation>(tapTime[t] + m, s, numSamples)
+                              + feedbackLine.popFrame<tierSettings.interpolation>(tapTime[t] + m);
+
+            Utils::StereoFrame feedbackFrame;
+            if constexpr (tierSettings.fastMath)
+                feedbackFrame = Utils::fastTanh(delayedFrame * tapFeedbackGain[t]);
+            else
+                feedbackFrame = Utils::exactTanh(delayedFrame * tapFeedbackGain[t]);
+
+            feedbackLine.pushFrame(damping.processFrame<tierSettings.dampingFilterOrder>(lane, feedbackFrame));
+
+            // A lone channel has nowhere to pan to
+            if constexpr (Stereo)
+                output.write<Stereo>(s, delayedFrame * tapGain[t]);
+            else
+                output.write<Stereo>(s, delayedFrame * tapVolume[t]);
         }
+    }
+
+    inline void ThreeTapDelay::reset()
+    {
+        for(auto& l : dryLine)
+            l.reset();
+        for(auto& l : feedbackLane)
+            l.reset();
+
+        damping.reset();
+    }
+
+    // One task per tap and channel pair, for sizing a TaskPool.
+    inline int ThreeTapDelay::getMaxTasks(int numChannels) const
+    {
+        return numberOfTaps * Utils::getNumChannelPairs(numChannels);
+    }
+
+    // The longest tap that is mixed in, each feedback tap going round its
+    // own lane once per repeat. tanh and the damping filter only take level
+    // away, so this is an upper bound.
+    inline float ThreeTapDelay::getTailInSamples(float threshold) const
+    {
+        auto repeats = delayFeedback > 0.f ? std::ceil(std::log(threshold) / std::log(delayFeedback)) : 0.f;
 
-        // Apply pan to each delay depending on width parameter
-        if (delayPanWidth != 0.f)
+        float tail = 0.f;
+        for(size_t t = 0; t < static_cast<size_t>(numActiveTaps); ++t)
         {
-            for(int i = 0; i < 3; ++i)
-            {
-                if (tapVolume[i] > 0)
-                {
-                    juce::dsp::AudioBlock<float> block(tapBuffer[i]);
-                    tapPan[i].process(juce::dsp::ProcessContextReplacing<float>(block));
-                }
-            }
+            auto tapRepeats = tapFeedbackGain[t] > 0.f ? repeats : 0.f;
+            tail = juce::jmax(tail, (tapTime[t] + 2.f * modAmount) * (1.f + tapRepeats));
         }
 
-        // Mix all the taps signals on buffer
-        for(int i = 0; i < 3; ++i)
+        return tail;
+    }
+
+    // Times, gains and feedback for the current parameters. Each tap with
+    // feedback on loops at the feedback amount, as it would on a line of its
+    // own.
+    inline void ThreeTapDelay::updateTaps()
+    {
+        numActiveTaps = 0;
+        for(size_t t = 0; t < tapTime.size(); ++t)
         {
-            if (i == 0)
-            {
-                buffer.makeCopyOf(tapBuffer[i]);
-                buffer.applyGain(tapVolume[i]);
-            } else {
-                for(int ch = 0; ch < channels; ++ch)
-                {
-                    if (tapVolume[i] > 0)
-                        buffer.addFromWithRamp(ch, 0, tapBuffer[i].getReadPointer(ch), numSamples, tapVolume[i], tapVolume[i]);
-                }
-            }
+            auto index = static_cast<float>(t);
+            tapTime[t] = static_cast<float>(sampleRate) * (delayTime + index * delaySpread) * .001f;
+            tapVolume[t] = juce::jlimit(0.f, 1.f, delayTaps - index);
+
+            // The first tap leans one way and the second the other, with the
+            // balanced rule of juce::dsp::Panner: full level on the side the
+            // tap leans to
+            auto pan = t % 3 == 0 ? delayPanWidth : t % 3 == 1 ? -delayPanWidth : 0.f;
+            tapGain[t] = Utils::StereoFrame::make(tapVolume[t] * juce::jmin(1.f, 1.f - pan), tapVolume[t] * juce::jmin(1.f, 1.f + pan));
+
+            if (tapVolume[t] > 0.f)
+                numActiveTaps = static_cast<int>(t) + 1;
+
+            tapFeedbackGain[t] = tapFeedback[t] && tapVolume[t] > 0.f ? delayFeedback : 0.f;
         }
     }
 
     //========================================================================================
     inline void ThreeTapDelay::setDelayTime(float time) {
-        if (time != delayTime) 
+        if (time != delayTime)
         {
             delayTime = time;
-
-            tap[0]->setDelayTime(delayTime);
-            tap[1]->setDelayTime(delayTime + delaySpread);
-            tap[2]->setDelayTime(delayTime + 2.f * delaySpread);
+            updateTaps();
         }
     }
 
@@ -129,9 +288,7 @@ namespace AudioProcessorBlock
         if (spread != delaySpread)
         {
             delaySpread = spread;
-
-            tap[1]->setDelayTime(delayTime + delaySpread);
-            tap[2]->setDelayTime(delayTime + 2.f * delaySpread);
+            updateTaps();
         }
     }
 
@@ -139,94 +296,46 @@ namespace AudioProcessorBlock
         if (width != delayPanWidth)
         {
             delayPanWidth = width;
-
-            tapPan[0].setPan(delayPanWidth);
-            tapPan[1].setPan(-delayPanWidth);
+            updateTaps();
         }
     }
 
+    // Taps come in one after the other: 1.5 is the first tap at full level
+    // and the second at half.
     inline void ThreeTapDelay::setDelayTaps(float taps) {
         if (taps != delayTaps)
         {
-            if (taps <= 1) {
-                tapVolume[0] = taps;
-                tapVolume[1] = 0.f;
-                tapVolume[2] = 0.f;
-            }
-
-            if (taps > 1 && taps <= 2) {
-                tapVolume[0] = 1.f;
-                tapVolume[1] = taps - 1.f;
-                tapVolume[2] = 0;
-            }
-
-            if (taps > 2) {
-                tapVolume[0] = 1.f;
-                tapVolume[1] = 1.f;
-                tapVolume[2] = taps - 2.f;
-            }
+            delayTaps = taps;
+            updateTaps();
         }
     }
 
     inline void ThreeTapDelay::setDelayFeedback(float feedback) {
-        if (feedback != delayFeedback) 
+        if (feedback != delayFeedback)
         {
             delayFeedback = feedback;
-
-            if (tap1Feedback)
-                tap[0]->setFeedback(delayFeedback);
-            if (tap2Feedback)
-                tap[1]->setFeedback(delayFeedback);
-            if (tap3Feedback)
-                tap[2]->setFeedback(delayFeedback);
+            updateTaps();
         }
     }
 
-    inline void ThreeTapDelay::setTapsFeeback(bool t1Feedback, bool t2Feedback, bool t3Feedback) 
+    inline void ThreeTapDelay::setTapsFeeback(bool t1Feedback, bool t2Feedback, bool t3Feedback)
     {
-        if (tap1Feedback != t1Feedback)
-        {
-            tap1Feedback = t1Feedback;
-            if (tap1Feedback)
-                tap[0]->setFeedback(delayFeedback);
-            else
-                tap[0]->setFeedback(0.f);
-        }
+        const bool flags[] = { t1Feedback, t2Feedback, t3Feedback };
 
-        if (tap2Feedback != t2Feedback)
+        auto changed = false;
+        for(size_t t = 0; t < tapFeedback.size() && t < 3; ++t)
         {
-            tap2Feedback = t2Feedback;
-            if (tap2Feedback)
-                tap[1]->setFeedback(delayFeedback);
-            else
-                tap[1]->setFeedback(0.f);
+            changed |= tapFeedback[t] != flags[t];
+            tapFeedback[t] = flags[t];
         }
 
-        if (tap3Feedback != t3Feedback)
-        {
-            tap3Feedback = t3Feedback;
-            if (tap3Feedback)
-                tap[2]->setFeedback(delayFeedback);
-            else
-                tap[2]->setFeedback(0.f);
-        }
+        if (changed)
+            updateTaps();
     }
 
-    inline void ThreeTapDelay::setTapsModulation(float freq, float amount)
+    inline void ThreeTapDelay::setTapsModulation(float amount)
     {
-        if (freq != modFrequency)
-        {
-            modFrequency = freq;
-            for (auto& t : tap)
-                t->setModFreq(modFrequency);
-        }
-
-        if (amount != modAmount)
-        {
-            modAmount = amount;
-            for (auto& t : tap)
-                t->setModAmount(modAmount);
-        }
+        modAmount = amount;
     }
 
     inline void ThreeTapDelay::setTapsDamping(float freq)
@@ -234,9 +343,17 @@ namespace AudioProcessorBlock
         if (freq != tapDamping)
         {
             tapDamping = freq;
-            for (auto& t : tap)
-                t->setDamp(tapDamping);
+            damping.setCutoff(tapDamping);
         }
     }
 
-}
\ No newline at end of file
+    inline void ThreeTapDelay::setQuality(Utils::Quality newQuality)
+    {
+        if (newQuality == quality)
+            return;
+
+        quality = newQuality;
+        settings = Utils::QualitySettings::forTier(quality);
+        damping.setOrder(settings.dampingFilterOrder);
+    }
+}
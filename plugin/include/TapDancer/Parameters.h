@@ -0,0 +1,162 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace TapDancer
+{
+    // Groups of parameters that are pushed to the DSP together, as bits.
+    enum ParameterGroup : uint32_t
+    {
+        preampParams   = 1 << 0,
+        tapsParams     = 1 << 1,
+        diffuserParams = 1 << 2,
+        outputParams   = 1 << 3,
+        allParams      = preampParams | tapsParams | diffuserParams | outputParams
+    };
+
+    // Every parameter value processBlock needs, copied once per block.
+    struct ParameterSnapshot
+    {
+        float saturation{ 1.f }, tone{ 20000.f }, gain{ 1.f };
+        float taps{ 0.f }, feedback{ 0.f }, width{ 0.f }, time{ 250.f }, spread{ 0.f };
+        bool tap1Feedback{ false }, tap2Feedback{ false }, tap3Feedback{ false };
+        float diffusion{ 0.f }, modulation{ 0.f }, damp{ 20000.f };
+        int diffuserType{ 0 };
+        float lowCut{ 20.f }, dryWet{ .5f }, outputGain{ 1.f };
+        int quality{ 1 };
+        bool governor{ false };
+    };
+
+    // Resolves each parameter's value handle once, by ID, and listens to the
+    // parameters themselves so a change only sets the bits of the groups it
+    // feeds. Listener callbacks come by parameter index, so nothing on the
+    // audio thread hashes or compares strings.
+    class ParameterCache : private juce::AudioProcessorParameter::Listener
+    {
+    public:
+        explicit ParameterCache(juce::AudioProcessorValueTreeState& state)
+        {
+            groupsByIndex.resize(static_cast<size_t>(state.processor.getParameters().size()), 0);
+
+            for (size_t i = 0; i < bindings.size(); ++i)
+            {
+                values[i] = state.getRawParameterValue(bindings[i].id);
+                parameters[i] = state.getParameter(bindings[i].id);
+                jassert(values[i] != nullptr && parameters[i] != nullptr);
+
+                groupsByIndex[static_cast<size_t>(parameters[i]->getParameterIndex())] = bindings[i].groups;
+                parameters[i]->addListener(this);
+            }
+        };
+
+        ~ParameterCache() override
+        {
+            for (auto* p : parameters)
+                p->removeListener(this);
+        };
+
+        // Refreshes snapshot and returns the groups that changed since the
+        // last call. The bits are taken before the values are read, so a
+        // change that lands in between is either in this snapshot or marks
+        // its group for the next one, never lost.
+        uint32_t update(ParameterSnapshot& snapshot)
+        {
+            auto changed = dirty.exchange(0, std::memory_order_acquire);
+            read(snapshot);
+            return changed;
+        };
+
+        // Fills snapshot with the current values, from any thread, and leaves
+        // the changed groups for update().
+        void read(ParameterSnapshot& snapshot) const
+        {
+            snapshot.saturation   = get(saturate);
+            snapshot.tone         = get(tone);
+            snapshot.gain         = get(gain);
+            snapshot.taps         = get(taps);
+            snapshot.feedback     = get(feedback);
+            snapshot.tap1Feedback = get(tap1Feedback) > .5f;
+            snapshot.tap2Feedback = get(tap2Feedback) > .5f;
+            snapshot.tap3Feedback = get(tap3Feedback) > .5f;
+            snapshot.width        = get(width);
+            snapshot.time         = get(time);
+            snapshot.spread       = get(spread);
+            snapshot.diffusion    = get(diffuser);
+            snapshot.diffuserType = static_cast<int>(get(diffuserType));
+            snapshot.modulation   = get(modulation);
+            snapshot.damp         = get(damp);
+            snapshot.lowCut       = get(lowCut);
+            snapshot.dryWet       = get(dryWet);
+            snapshot.outputGain   = get(outputGain);
+            snapshot.quality      = static_cast<int>(get(quality));
+            snapshot.governor     = get(governor) > .5f;
+        };
+
+    private:
+        enum Id
+        {
+            saturate, tone, gain,
+            taps, feedback, tap1Feedback, tap2Feedback, tap3Feedback, width, time, spread,
+            diffuser, diffuserType, modulation, damp,
+            lowCut, dryWet, outputGain,
+            quality, governor,
+            numIds
+        };
+
+        struct Binding
+        {
+            const char* id;
+            uint32_t groups;
+        };
+
+        // In Id order. Quality is read every block for the governor, so it
+        // belongs to no group.
+        static constexpr std::array<Binding, numIds> bindings{ {
+            { "SATURATE_ID", preampParams },
+            { "TONE_ID", preampParams },
+            { "GAIN_ID", preampParams },
+            { "TAPS_ID", tapsParams },
+            { "FEEDBACK_ID", tapsParams },
+            { "TAP1F_ID", tapsParams },
+            { "TAP2F_ID", tapsParams },
+            { "TAP3F_ID", tapsParams },
+            { "WIDTH_ID", tapsParams },
+            { "TIME_ID", tapsParams },
+            { "TSPREAD_ID", tapsParams },
+            { "DIFFUSER_ID", diffuserParams },
+            { "DIFFUSER_TYPE_ID", diffuserParams },
+            { "MOD_ID", tapsParams | diffuserParams },
+            { "DAMP_ID", tapsParams | diffuserParams },
+            { "LOWCUT_ID", outputParams },
+            { "DRYWET_ID", outputParams },
+            { "OUTPUT_ID", outputParams },
+            { "QUALITY_ID", 0 },
+            { "GOVERNOR_ID", 0 }
+        } };
+
+        float get(Id id) const
+        {
+            return values[static_cast<size_t>(id)]->load(std::memory_order_relaxed);
+        };
+
+        void parameterValueChanged(int parameterIndex, float) override
+        {
+            dirty.fetch_or(groupsByIndex[static_cast<size_t>(parameterIndex)], std::memory_order_release);
+        };
+
+        void parameterGestureChanged(int, bool) override
+        {};
+
+        std::array<std::atomic<float>*, numIds> values{};
+        std::array<juce::RangedAudioParameter*, numIds> parameters{};
+        std::vector<uint32_t> groupsByIndex;
+
+        // Everything starts out dirty, so the first block pushes it all
+        std::atomic<uint32_t> dirty{ allParams };
+    };
+}
@@ -2,6 +2,30 @@
 
 #include "PluginProcessor.h"
 
+//==============================================================================
+// Min / average / max share of the block deadline per stage, as reported by
+// the processor's StageMeter, with the instance it belongs to on top.
+class StageMeterView  : public juce::Component,
+                        private juce::Timer
+{
+public:
+    explicit StageMeterView (AudioPluginAudioProcessor&);
+    ~StageMeterView() override;
+
+    void paint (juce::Graphics&) override;
+
+private:
+    void timerCallback() override;
+    void paintRow (juce::Graphics&, juce::Rectangle<int> area, const juce::String& name,
+                   const Utils::StageMeter::Load& load);
+
+    AudioPluginAudioProcessor& processorRef;
+    Utils::StageMeter::Report report;
+    bool hasReport{ false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StageMeterView)
+};
+
 //==============================================================================
 class AudioPluginAudioProcessorEditor  : public juce::AudioProcessorEditor
 {
@@ -18,5 +42,20 @@ private:
     // access the processor object that created it.
     AudioPluginAudioProcessor& processorRef;
 
+    juce::GenericAudioProcessorEditor parameterEditor;
+    StageMeterView stageMeterView;
+
+    // The processor's preset bank
+    juce::ComboBox presetBox;
+
+    // Picks the impulse response for the convolution diffuser
+    juce::TextButton loadImpulseResponseButton{ "Load IR..." };
+    std::unique_ptr<juce::FileChooser> impulseResponseChooser;
+    void chooseImpulseResponse();
+
+    juce::ToggleButton wetDownsamplingButton{ "Downsample wet path" };
+
+    static constexpr int meterWidth = 320, minHeight = 320, buttonHeight = 32;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessorEditor)
 };
@@ -2,9 +2,28 @@
 
 #include "AudioProcessorBlock/ThreeTapDelay.h"
 #include "AudioProcessorBlock/BasicVerb.h"
+#include "AudioProcessorBlock/ConvolutionVerb.h"
+#include "AudioProcessorBlock/FdnVerb.h"
 #include "AudioProcessorBlock/Preamp.h"
+#include "TapDancer/Parameters.h"
+#include "TapDancer/Presets.h"
+#include "Utils/CoefficientTable.h"
+#include "Utils/DelayArena.h"
+#include "Utils/Dispatch.h"
+#include "Utils/FirstOrderFilter.h"
+#include "Utils/LfoBank.h"
+#include "Utils/QualityGovernor.h"
+#include "Utils/RateConverter.h"
+#include "Utils/RealtimeSafety.h"
+#include "Utils/SilenceGate.h"
+#include "Utils/StageMeter.h"
+#include "Utils/StageProfiler.h"
+#include "Utils/StatePublisher.h"
+#include "Utils/SubBlockScheduler.h"
+#include "Utils/TaskPool.h"
 
 #include <juce_audio_processors/juce_audio_processors.h>
+#include <atomic>
 #include <vector>
 
 //==============================================================================
@@ -24,6 +43,9 @@ public:
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
     using AudioProcessor::processBlock;
 
+    void setNonRealtime (bool nonRealtime) noexcept override;
+    void updateTrackProperties (const TrackProperties& properties) override;
+
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
@@ -50,6 +72,33 @@ public:
     //== Tree States ===============================================================
     juce::AudioProcessorValueTreeState treeState;
 
+    //== Profiling =================================================================
+    // Optional per-stage timing, used by the headless benchmark. Not owned.
+    void setStageProfiler(Utils::StageProfiler* profiler) { stageProfiler = profiler; };
+
+    // Always-on per-stage load, read by the editor. Reports come out of a
+    // single consumer FIFO, so only one reader may pop them.
+    Utils::StageMeter& getStageMeter() { return stageMeter; };
+
+    // Tells this instance apart in the meter: its load order and, once the
+    // host has sent it, the name of its track.
+    juce::String getInstanceName() const;
+
+    // Loads an impulse response for the convolution diffuser in the
+    // background; the audio thread switches to it once it is ready.
+    void loadImpulseResponse(const juce::File& file);
+    juce::File getImpulseResponseFile() const { return convolutionVerb.getImpulseResponseFile(); };
+
+    // Runs the taps and the diffuser at 44.1 or 48 kHz when the host runs at
+    // twice or four times that; the preamp, the dry signal and the output
+    // stage stay at the host rate. Not for the audio thread: re-prepares
+    // the processor when it is already playing.
+    void setWetDownsampling(bool shouldDownsample);
+    bool isWetDownsampling() const { return wetDownsampling.load(); };
+
+    // Delay line memory per stage, as laid out by the last prepareToPlay.
+    const Utils::DelayArena& getDelayArena() const { return delayArena; };
+
 private:
     //==============================================================================
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
@@ -59,16 +108,129 @@ private:
     AudioProcessorBlock::Preamp preamp;
     AudioProcessorBlock::ThreeTapDelay tapsDelay;
     AudioProcessorBlock::BasicVerb diffuser1stStage, diffuser2stStage;
+    AudioProcessorBlock::FdnVerb fdnVerb;
+    AudioProcessorBlock::ConvolutionVerb convolutionVerb;
     juce::AudioBuffer<float> diffuser2stStageBuffer, delayedBuffer;
 
+    // The second diffuser stage's output on its way back into the first,
+    // a ring of diffuserFeedbackDelay samples at the wet path's rate.
+    juce::AudioBuffer<float> diffuserFeedback;
+    int diffuserFeedbackPosition{ 0 };
+    void feedDiffuser(juce::AudioBuffer<float>& buffer);
+    void storeDiffuserFeedback(const juce::AudioBuffer<float>& output);
+
+    // One LFO per modulation rate, rendered once per block and shared by
+    // every tap and both diffuser stages.
+    enum LfoVoice { tapsLfo, diffuserLfo, numLfoVoices };
+    Utils::LfoBank lfoBank;
+
+    // How MOD_ID and DIFFUSER_ID map onto the DSP blocks, in samples at the
+    // host rate; wetRateScale takes them to the wet path's rate. prepareToPlay
+    // sizes the delay lines from these, so keep them in step with the update
+    // code.
+    static constexpr float tapsModulationDepth = 100.f, diffuserModulationDepth = 40.f;
+    static constexpr float diffuserDecayScale = 1200.f, diffuserDecayOffset = 600.f;
+    // Share of the second diffuser stage fed back into the first, and how
+    // much later it gets there. A fixed delay rather than a block, so the
+    // sound does not follow the block size.
+    static constexpr float diffuserBlockFeedback = .6f, diffuserFeedbackDelay = 512.f;
+    // DIFFUSER_TYPE_ID picks the two BasicVerb stages, the FdnVerb or the
+    // ConvolutionVerb. The network's longest line is the scaled decay, and
+    // DIFFUSER_ID sets its decay time in seconds.
+    enum DiffuserType { allpassDiffuser, fdnDiffuser, convolutionDiffuser };
+    static constexpr float fdnSizeScale = 2.f, fdnDecayScale = 4.6f, fdnDecayOffset = .4f;
+    int diffuserType{ allpassDiffuser };
+    Utils::DelayArena delayArena;
+
+    // Worker threads for offline bounces. Empty while the host plays in real
+    // time, in which case every stage runs on the audio thread as usual.
+    Utils::TaskPool offlinePool;
+    void updateOfflinePool();
+
+    // Parameter values for the current sub-block, and the groups that still
+    // have to be pushed to their stage.
+    TapDancer::ParameterCache parameterCache;
+    TapDancer::ParameterSnapshot params;
+    uint32_t pendingParams{ TapDancer::allParams };
+    bool takePending(TapDancer::ParameterGroup group);
+    void readParameters();
+
+    // Presets and saved states come in through the parameters, so the host
+    // and the editor follow, but the audio thread takes them as one snapshot
+    // rather than value by value. It ignores the parameters while one is
+    // being written, and throws away a read that a load started during,
+    // then fades the wet path out on the old snapshot and back in on the
+    // new one, a sub-block each way. Nothing is reallocated.
+    std::vector<TapDancer::Preset> presetBank{ TapDancer::createFactoryPresets() };
+    int currentProgram{ 0 };
+    Utils::StatePublisher<TapDancer::ParameterSnapshot> presetChanges;
+    std::atomic<uint32_t> presetLoadsStarted{ 0 }, presetLoadsFinished{ 0 };
+    enum PresetFade { noFade, fadingOut, fadingIn };
+    int presetFade{ noFade };
+    TapDancer::StateValues getStateValues() const;
+    void applyStateValues(const TapDancer::StateValues& values);
+    void applyPresetFade(juce::AudioBuffer<float>& buffer);
+
+    // Which parts of the chain a sub-block runs. processSubBlock picks one
+    // and each gets its own processChain, with the stages and their inner
+    // loops specialised for it.
+    template <bool Taps, bool Diffuser, bool Modulated>
+    struct ChainVariant
+    {
+        static constexpr bool hasTaps = Taps, hasDiffuser = Diffuser, isModulated = Modulated;
+    };
+
+    // Everything from the parameter read to the output gain runs on whole
+    // sub-blocks of subBlockSize, one sub-block behind the host, so the
+    // output does not depend on how the host slices its blocks, and stages
+    // always get the full block they were prepared for.
+    static constexpr int subBlockSize = 64;
+    Utils::SubBlockScheduler subBlocks;
+    void processSubBlock(juce::AudioBuffer<float>& buffer);
+
+    template <typename Variant>
+    void processChain(juce::AudioBuffer<float>& buffer);
+    template <typename Variant>
+    void processWetPath(juce::AudioBuffer<float>& buffer);
+
+    // The taps and the diffuser, the wet path, run at wetSampleRate. Tails
+    // and maxBlockSize are counted at that rate too.
+    Utils::RateConverter wetRateConverter;
+    std::atomic<bool> wetDownsampling{ false };
+    double wetSampleRate{ 44100.0 };
+    float wetRateScale{ 1.f };
+
+    // Stages that have gone quiet stop running until signal comes back. The
+    // gates need each stage's tail, which is also what the host is told.
+    Utils::SilenceGate preampGate, tapsGate, diffuserGate;
+    std::atomic<double> tailLengthSeconds{ 0.0 };
+    bool tailNeedsUpdate{ true };
+    int maxBlockSize{ 0 };
+    void updateTailLength();
+
+    void updateQuality();
+    void applyQuality(Utils::Quality tier);
     void updatePreampParams();
     void updateTapsDelayParams();
     void updateBasicVerbParams();
     void updateOutputParams();
 
     juce::dsp::DryWetMixer<float> dryWetMixer, decayAmountMixer;
-    juce::dsp::ProcessorDuplicator<juce::dsp::IIR::Filter<float>, juce::dsp::IIR::Coefficients<float>> lowCutFilter;
+    Utils::FirstOrderFilter lowCutFilter;
+    Utils::FirstOrderTable lowCutTable;
+
+    Utils::StageProfiler* stageProfiler{ nullptr };
+    Utils::StageMeter stageMeter;
+    void lapStage(Utils::Stage stage);
+
+    int instanceNumber{ 0 };
+    juce::String trackName;
+    juce::CriticalSection trackNameLock;
+
+    Utils::QualityGovernor qualityGovernor;
+    Utils::Quality quality{ Utils::Quality::high };
+    bool governorEnabled{ false };
 
     double lastSampleRate;
-    float dryWetProportion{ 0.f }, lowCutFrequency{ 20.f }, outGain{ 1.f };
+    float dryWetProportion{ 0.f }, lowCutFrequency{ 20.f }, outGain{ 1.f }, lastOutGain{ 1.f };
 };
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace TapDancer
+{
+    // Every parameter the saved state holds, in the order it holds them.
+    // Only ever append: a state stores how many values it has, so older
+    // states simply stop early and the rest keep their defaults. Quality and
+    // the governor are settings of the machine rather than of the sound, so
+    // presets leave them alone.
+    struct StateParameter
+    {
+        const char* id;
+        bool inPresets;
+    };
+
+    inline constexpr std::array<StateParameter, 20> stateParameters{ {
+        { "SATURATE_ID", true },
+        { "TONE_ID", true },
+        { "GAIN_ID", true },
+        { "TAPS_ID", true },
+        { "FEEDBACK_ID", true },
+        { "TAP1F_ID", true },
+        { "TAP2F_ID", true },
+        { "TAP3F_ID", true },
+        { "WIDTH_ID", true },
+        { "TIME_ID", true },
+        { "TSPREAD_ID", true },
+        { "DIFFUSER_ID", true },
+        { "DIFFUSER_TYPE_ID", true },
+        { "MOD_ID", true },
+        { "DAMP_ID", true },
+        { "LOWCUT_ID", true },
+        { "DRYWET_ID", true },
+        { "OUTPUT_ID", true },
+        { "QUALITY_ID", false },
+        { "GOVERNOR_ID", false }
+    } };
+
+    inline constexpr auto numStateParameters = static_cast<int>(stateParameters.size());
+
+    // Plain values, in the parameters' own units, in stateParameters order.
+    using StateValues = std::array<float, stateParameters.size()>;
+
+    // A preset names the parameters it moves away from their defaults.
+    struct Preset
+    {
+        juce::String name;
+        std::vector<std::pair<const char*, float>> values;
+    };
+
+    inline std::vector<Preset> createFactoryPresets()
+    {
+        return {
+            { "Init", {} },
+            { "Slapback", { { "TAPS_ID", 1.f }, { "TIME_ID", 120.f }, { "FEEDBACK_ID", .1f },
+                            { "SATURATE_ID", 1.2f }, { "TONE_ID", 9000.f }, { "DRYWET_ID", .35f } } },
+            { "Triplet Echoes", { { "TAPS_ID", 3.f }, { "TIME_ID", 375.f }, { "TSPREAD_ID", 125.f }, { "FEEDBACK_ID", .45f },
+                                  { "TAP1F_ID", 1.f }, { "TAP2F_ID", 1.f }, { "TAP3F_ID", 1.f }, { "WIDTH_ID", .6f },
+                                  { "DAMP_ID", 8000.f }, { "DRYWET_ID", .4f } } },
+            { "Diffuse Hall", { { "TAPS_ID", 2.f }, { "TIME_ID", 180.f }, { "TSPREAD_ID", 60.f }, { "FEEDBACK_ID", .3f },
+                                { "DIFFUSER_ID", .7f }, { "MOD_ID", .2f }, { "DAMP_ID", 7000.f }, { "LOWCUT_ID", 150.f },
+                                { "DRYWET_ID", .45f } } },
+            { "Network Bloom", { { "TAPS_ID", 1.f }, { "TIME_ID", 90.f }, { "DIFFUSER_ID", .8f }, { "DIFFUSER_TYPE_ID", 1.f },
+                                 { "MOD_ID", .35f }, { "DAMP_ID", 9000.f }, { "LOWCUT_ID", 200.f }, { "DRYWET_ID", .5f } } },
+            { "Chorus Wash", { { "TAPS_ID", 2.f }, { "TIME_ID", 60.f }, { "TSPREAD_ID", 15.f }, { "FEEDBACK_ID", .2f },
+                               { "WIDTH_ID", 1.f }, { "MOD_ID", .8f }, { "DIFFUSER_ID", .3f }, { "DRYWET_ID", .5f } } }
+        };
+    }
+
+    // Everything getStateInformation saves, in a compact binary form:
+    //   magic, version, value count, the values as floats, flags, program,
+    //   impulse response path
+    // all little endian. Fields are only added at the end, where older
+    // readers stop; the version only goes up for changes they cannot skip,
+    // and they refuse those.
+    struct State
+    {
+        static constexpr juce::uint32 magic = 0x54447374; // "TDst"
+        static constexpr juce::uint16 version = 1;
+
+        StateValues values{};
+        bool wetDownsampling{ false };
+        int program{ 0 };
+        juce::String impulseResponse;
+
+        void write(juce::MemoryBlock& destData) const
+        {
+            juce::MemoryOutputStream stream(destData, false);
+            stream.writeInt(static_cast<int>(magic));
+            stream.writeShort(static_cast<short>(version));
+            stream.writeShort(static_cast<short>(numStateParameters));
+
+            for (auto value : values)
+                stream.writeFloat(value);
+
+            stream.writeByte(static_cast<char>(wetDownsampling ? 1 : 0));
+            stream.writeInt(program);
+            stream.writeString(impulseResponse);
+        };
+
+        // Fills in what data has and leaves the rest as it was. Returns false
+        // when data is not a state this version can read.
+        bool read(const void* data, int sizeInBytes)
+        {
+            juce::MemoryInputStream stream(data, static_cast<size_t>(juce::jmax(0, sizeInBytes)), false);
+            if (stream.getTotalLength() < 8
+             || static_cast<juce::uint32>(stream.readInt()) != magic
+             || static_cast<juce::uint16>(stream.readShort()) > version)
+                return false;
+
+            auto numValues = static_cast<int>(static_cast<juce::uint16>(stream.readShort()));
+            if (stream.getNumBytesRemaining() < static_cast<juce::int64>(numValues) * 4)
+                return false;
+
+            for (int i = 0; i < numValues; ++i)
+            {
+                auto value = stream.readFloat();
+                if (i < numStateParameters)
+                    values[static_cast<size_t>(i)] = value;
+            }
+
+            if (stream.isExhausted())
+                return true;
+
+            wetDownsampling = stream.readByte() != 0;
+            program = stream.readInt();
+            impulseResponse = stream.readString();
+            return true;
+        };
+    };
+}
@@ -1,6 +1,9 @@
 #pragma once
 
-#include "Utils/Sine.h"
+#include "Utils/DelayArena.h"
+#include "Utils/Dispatch.h"
+#include "Utils/Modulation.h"
+#include "Utils/Quality.h"
 
 #include <juce_dsp/juce_dsp.h>
 #include <juce_audio_processors/juce_audio_processors.h>
@@ -9,7 +12,7 @@ namespace Utils {
     class AllPass
     {
     public:
-        AllPass() : sampleRate{ 44100.f }, feedback{ 0.56f }, isModulated{ false }
+        AllPass() : isModulated{ false }, sampleRate{ 44100.f }, feedback{ 0.56f }
         {};
 
         ~AllPass()
@@ -17,69 +20,68 @@ namespace Utils {
 
         void prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate, int maxDelayInSamples)
         {
-            delay.resize(spec.numChannels);
+            delay.resize(static_cast<size_t>(getNumChannelPairs(static_cast<int>(spec.numChannels))));
             for (auto& d : delay)
-            {
-                d.reset();
-                d.prepare(spec);
-                d.setMaximumDelayInSamples(maxDelayInSamples);
-                d.setDelay(1);
-            }
-
-            modOsc.resize(spec.numChannels);
-            for (auto& o : modOsc)
-                o.prepare(_sampleRate);
+                d.prepare(maxDelayInSamples);
 
             modAmount = 20;
-            modFreq = 1;
             sampleRate = _sampleRate;
         };
 
-        void process(juce::AudioSampleBuffer &buffer, int channel)
+        void registerDelayMemory(DelayArena& arena, Stage stage)
+        {
+            for (auto& d : delay)
+                arena.add(stage, d);
+        };
+
+        // Processes every channel of the buffer, two at a time. modulation
+        // holds one LFO value in [-1, 1] per sample for each pair. The right
+        // lane reads it inverted so the stereo image moves.
+        void process(juce::AudioSampleBuffer &buffer, const Modulation& modulation)
+        {
+            for (int pair = 0; pair < getNumChannelPairs(buffer.getNumChannels()); ++pair)
+                processPair(buffer, pair, modulation.forPair(pair));
+        };
+
+        // One channel pair on its own, see Utils::Delay::processPair.
+        void processPair(juce::AudioSampleBuffer &buffer, int pair, const float* modulation)
         {
-            auto* inputSamples = buffer.getReadPointer(channel);
-            auto* outputSamples = buffer.getWritePointer(channel);
+            auto channels = getChannelPair(buffer, pair);
             auto numSamples = buffer.getNumSamples();
-            float m = .0f;
 
-            for (int s = 0; s < numSamples; ++s)
-            {
-                if (isModulated)
-                    m = modOsc[channel].getNextSample() * modAmount;
-
-                if (channel == 1)
-                    m *= -1;
-            
-                float delayedSample = delay[channel].popSample(channel, apSampleDelay + m);
-                float sampleToDelay = inputSamples[s] + (-feedback * delayedSample);
-                delay[channel].pushSample(channel, sampleToDelay);
-                outputSamples[s] = delayedSample + (feedback * sampleToDelay);
-            }
+            withQuality(quality, [&] (auto tier) {
+                withFlag(isModulated && modulation != nullptr && modAmount != 0, [&] (auto modulated) {
+                    withPairLayout(channels, [&] (auto stereo) {
+                        processFrames<decltype(tier)::value, decltype(modulated)::value, decltype(stereo)::value>(
+                            channels, pair, modulation, numSamples);
+                    });
+                });
+            });
         };
 
-        void setAPSampleDelay(float apDelay)
+        void reset()
         {
-            if (apDelay != apSampleDelay)
-            {
-                apSampleDelay = apDelay;
-                for (auto& d : delay)
-                    d.setDelay(apSampleDelay);
-            }
+            for (auto& d : delay)
+                d.reset();
         };
 
-        void setFeedback(float _feedback)
+        // Samples until an impulse has fallen below threshold. The response
+        // loses a factor of feedback on every trip around the line.
+        float getTailInSamples(float threshold) const
         {
-            feedback = _feedback;
+            auto gain = std::abs(feedback);
+            auto repeats = gain > 0.f ? std::ceil(std::log(threshold) / std::log(gain)) : 0.f;
+            return (apSampleDelay + (isModulated ? std::abs(modAmount) : 0.f)) * (1.f + repeats);
         };
 
-        void setModFreq(float freq)
+        void setAPSampleDelay(float apDelay)
         {
-            if (freq != modFreq)
-            {
-                modFreq = freq;
-                for (auto& o : modOsc)
-                    o.setFrequency(modFreq);
-            }
+            apSampleDelay = apDelay;
+        };
+
+        void setFeedback(float _feedback)
+        {
+            feedback = _feedback;
         };
 
         void setModAmount(float amount)
@@ -94,12 +96,43 @@ namespace Utils {
                 isModulated = isOn;
         };
 
+        void setQuality(Quality newQuality)
+        {
+            quality = newQuality;
+        };
+
     private:
         bool isModulated;
         double sampleRate;
-        float feedback, apSampleDelay, modFreq, modAmount;
+        float feedback, apSampleDelay{ 1.f }, modAmount;
+        Quality quality{ Quality::high };
+
+        std::vector<StereoRingBuffer> delay;
+
+        // The per-sample loop, see Utils::Delay::processFrames.
+        template <Quality Tier, bool Modulated, bool Stereo>
+        void processFrames(const ChannelPair& channels, int pair, const float* modulation, int numSamples)
+        {
+            constexpr auto interpolation = QualitySettings::forTier(Tier).interpolation;
+            auto& line = delay[static_cast<size_t>(pair)];
 
-        std::vector<Utils::Sine> modOsc;
-        std::vector<juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::Thiran>> delay;
+            for (int s = 0; s < numSamples; ++s)
+            {
+                StereoFrame delayedFrame;
+                if constexpr (Modulated)
+                {
+                    auto m = modulation[s] * modAmount;
+                    delayedFrame = line.popFrame<interpolation>(apSampleDelay + m, apSampleDelay - m);
+                }
+                else
+                {
+                    delayedFrame = line.popFrame<interpolation>(apSampleDelay);
+                }
+
+                auto frameToDelay = channels.read<Stereo>(s) - delayedFrame * feedback;
+                line.pushFrame(frameToDelay);
+                channels.write<Stereo>(s, delayedFrame + frameToDelay * feedback);
+            }
+        };
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace Utils
+{
+    // Filter coefficients designed ahead of time for cutoffs from 10 Hz to
+    // just under Nyquist, on a log grid (about 13 cents apart at 44.1 kHz),
+    // so moving a cutoff costs one log2 and a linear blend of two rows
+    // instead of a filter design. For the one and two pole filters in the
+    // chain the stable coefficient region is convex, so a blend of two stable
+    // rows is stable as well.
+    template <size_t NumCoefficients>
+    class CoefficientTable
+    {
+    public:
+        using Coefficients = std::array<float, NumCoefficients>;
+
+        static constexpr int numPoints = 1024;
+        static constexpr float minFrequency = 10.f;
+
+        CoefficientTable()
+        {};
+
+        ~CoefficientTable()
+        {};
+
+        // design(frequency) returns the coefficients for one cutoff in Hz.
+        // Allocates, so call it from prepareToPlay.
+        template <typename Design>
+        void prepare(double sampleRate, Design&& design)
+        {
+            maxFrequency = static_cast<float>(sampleRate * .49);
+            logMinFrequency = std::log2(minFrequency);
+            pointsPerOctave = static_cast<float>(numPoints - 1) / (std::log2(maxFrequency) - logMinFrequency);
+
+            table.resize(numPoints);
+            for (int i = 0; i < numPoints; ++i)
+                table[static_cast<size_t>(i)] = design(std::exp2(logMinFrequency + static_cast<float>(i) / pointsPerOctave));
+        };
+
+        bool isPrepared() const { return ! table.empty(); };
+
+        Coefficients lookup(float frequency) const
+        {
+            jassert(isPrepared());
+
+            auto position = (std::log2(juce::jlimit(minFrequency, maxFrequency, frequency)) - logMinFrequency) * pointsPerOctave;
+            auto index = juce::jlimit(0, numPoints - 2, static_cast<int>(position));
+            auto t = position - static_cast<float>(index);
+
+            auto& lower = table[static_cast<size_t>(index)];
+            auto& upper = table[static_cast<size_t>(index) + 1];
+
+            Coefficients coefficients;
+            for (size_t k = 0; k < NumCoefficients; ++k)
+                coefficients[k] = lower[k] + t * (upper[k] - lower[k]);
+
+            return coefficients;
+        };
+
+    private:
+        std::vector<Coefficients> table;
+        float maxFrequency{ 20000.f }, logMinFrequency{ 0.f }, pointsPerOctave{ 1.f };
+    };
+
+    // { b0, b1, a0, a1 } tables for Utils::FirstOrderFilter.
+    using FirstOrderTable = CoefficientTable<4>;
+
+    inline void prepareFirstOrderLowPass(FirstOrderTable& table, double sampleRate)
+    {
+        table.prepare(sampleRate, [sampleRate] (float frequency)
+        {
+            return juce::dsp::IIR::ArrayCoefficients<float>::makeFirstOrderLowPass(sampleRate, frequency);
+        });
+    }
+
+    inline void prepareFirstOrderHighPass(FirstOrderTable& table, double sampleRate)
+    {
+        table.prepare(sampleRate, [sampleRate] (float frequency)
+        {
+            return juce::dsp::IIR::ArrayCoefficients<float>::makeFirstOrderHighPass(sampleRate, frequency);
+        });
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Utils/CoefficientTable.h"
+#include "Utils/StereoFrame.h"
+
+#include <juce_core/juce_core.h>
+
+#include <cmath>
+#include <vector>
+
+namespace Utils
+{
+    // Low pass for the inside of a feedback loop: a one-pole or a Butterworth
+    // biquad. Both are designed for every cutoff up front in prepare(), so a
+    // cutoff change is a table lookup and never allocates. Both designs are
+    // kept up to date, so changing the order only swaps which one runs.
+    // Channels are filtered in pairs, see Utils::StereoFrame.
+    class DampingFilter
+    {
+    public:
+        DampingFilter()
+        {};
+
+        ~DampingFilter()
+        {};
+
+        void prepare(int numChannels, double _sampleRate)
+        {
+            sampleRate = _sampleRate;
+            state.resize(static_cast<size_t>(getNumChannelPairs(numChannels)));
+            reset();
+
+            onePoleTable.prepare(sampleRate, [this] (float freq) { return designOnePole(freq); });
+            biquadTable.prepare(sampleRate, [this] (float freq) { return designBiquad(freq); });
+            design();
+        };
+
+        void reset()
+        {
+            for (auto& s : state)
+                s = {};
+        };
+
+        void setCutoff(float freq)
+        {
+            if (freq != cutoff)
+            {
+                cutoff = freq;
+                design();
+            }
+        };
+
+        // 1 for the one-pole, 2 for the biquad.
+        void setOrder(int newOrder)
+        {
+            if (newOrder != order)
+            {
+                order = newOrder;
+                reset();
+            }
+        };
+
+        int getOrder() const { return order; };
+
+        // Order has to match getOrder(). It is a template argument so a block
+        // loop can pick it once instead of testing it every sample.
+        template <int Order>
+        StereoFrame processFrame(int pair, StereoFrame x)
+        {
+            auto& s = state[static_cast<size_t>(pair)];
+
+            if constexpr (Order == 1)
+            {
+                s.z1 = x + (s.z1 - x) * a1;
+                return s.z1;
+            }
+            else
+            {
+                // Transposed direct form II
+                auto y = x * b0 + s.z1;
+                s.z1 = x * b1 - y * c1 + s.z2;
+                s.z2 = x * b0 - y * c2;
+                return y;
+            }
+        };
+
+    private:
+        struct State
+        {
+            StereoFrame z1{ StereoFrame::expand(0.f) }, z2{ StereoFrame::expand(0.f) };
+        };
+
+        std::vector<State> state;
+        double sampleRate{ 44100.0 };
+        float cutoff{ 20000.f };
+        int order{ 2 };
+
+        // One-pole pole, and biquad coefficients normalised by a0. The biquad
+        // is symmetric, so b2 == b0.
+        float a1{ 0.f };
+        float b0{ 1.f }, b1{ 0.f }, c1{ 0.f }, c2{ 0.f };
+
+        CoefficientTable<1> onePoleTable;
+        CoefficientTable<4> biquadTable;
+
+        void design()
+        {
+            if (! biquadTable.isPrepared())
+                return;
+
+            a1 = onePoleTable.lookup(cutoff)[0];
+
+            auto biquad = biquadTable.lookup(cutoff);
+            b0 = biquad[0];
+            b1 = biquad[1];
+            c1 = biquad[2];
+            c2 = biquad[3];
+        };
+
+        // Impulse invariant one-pole: y += (1 - a1) * (x - y)
+        std::array<float, 1> designOnePole(float freq) const
+        {
+            auto w0 = juce::MathConstants<double>::twoPi * freq / sampleRate;
+            return { static_cast<float>(std::exp(-w0)) };
+        };
+
+        // RBJ cookbook low pass with Q = 1 / sqrt(2), as { b0, b1, c1, c2 }
+        std::array<float, 4> designBiquad(float freq) const
+        {
+            auto w0 = juce::MathConstants<double>::twoPi * freq / sampleRate;
+            auto cosW0 = std::cos(w0);
+            auto alpha = std::sin(w0) * juce::MathConstants<double>::sqrt2 * .5;
+            auto a0 = 1.0 + alpha;
+            return { static_cast<float>((1.0 - cosW0) * .5 / a0),
+                     static_cast<float>((1.0 - cosW0) / a0),
+                     static_cast<float>(-2.0 * cosW0 / a0),
+                     static_cast<float>((1.0 - alpha) / a0) };
+        };
+    };
+}
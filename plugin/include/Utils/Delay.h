@@ -3,7 +3,12 @@
 #include <juce_dsp/juce_dsp.h>
 #include <juce_audio_processors/juce_audio_processors.h>
 
-#include "Utils/Sine.h"
+#include "Utils/DampingFilter.h"
+#include "Utils/DelayArena.h"
+#include "Utils/Dispatch.h"
+#include "Utils/FastMath.h"
+#include "Utils/Modulation.h"
+#include "Utils/Quality.h"
 
 namespace Utils {
     class Delay
@@ -15,76 +20,79 @@ namespace Utils {
         ~Delay()
         {};
 
-        void prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate, float maxDelayInMs)
+        // maxModulationInSamples is the most the modulation can add on top
+        // of the delay time.
+        void prepare(const juce::dsp::ProcessSpec &spec, double _sampleRate, float maxDelayInMs, float maxModulationInSamples)
         {
-            auto maxDelayInSamples = static_cast<int>(msToSamples(maxDelayInMs));
+            sampleRate = _sampleRate;
+            auto maxDelayInSamples = static_cast<int>(std::ceil(msToSamples(maxDelayInMs) + maxModulationInSamples));
 
-            delay.resize(spec.numChannels);
+            delay.resize(static_cast<size_t>(getNumChannelPairs(static_cast<int>(spec.numChannels))));
             for (auto& d : delay)
-            {
-                d.reset();
-                d.prepare(spec);
-                d.setMaximumDelayInSamples(maxDelayInSamples);
-                d.setDelay(1);
-            }
+                d.prepare(maxDelayInSamples);
 
-            filterCoef = juce::dsp::FilterDesign<float>::designFIRLowpassWindowMethod(20000.f, _sampleRate, 21, juce::dsp::WindowingFunction<float>::hamming);
-            dampFilter.resize(spec.numChannels);
-            for (auto& f : dampFilter)
-            {
-                f.reset();
-                f.prepare(spec);
-                f.coefficients = filterCoef;
-            }
+            damping.prepare(static_cast<int>(spec.numChannels), sampleRate);
+            damping.setCutoff(dampFreq);
+            damping.setOrder(settings.dampingFilterOrder);
+        };
 
-            modOsc.resize(spec.numChannels);
-            for (auto& osc : modOsc)
-                osc.prepare(sampleRate);
+        void registerDelayMemory(DelayArena& arena, Stage stage)
+        {
+            for (auto& d : delay)
+                arena.add(stage, d);
+        };
 
-            modAmount = 20;
-            modFreq = 50;
-            sampleRate = _sampleRate;
+        // Processes every channel of the buffer, two at a time. modulation
+        // holds one LFO value in [-1, 1] per sample for each pair, or nothing
+        // when the tap is not modulated.
+        void process(juce::AudioSampleBuffer &buffer, const Modulation& modulation)
+        {
+            for (int pair = 0; pair < getNumChannelPairs(buffer.getNumChannels()); ++pair)
+                processPair(buffer, pair, modulation.forPair(pair));
         };
 
-        void process(juce::AudioSampleBuffer &buffer, int channel)
+        // One channel pair on its own, with that pair's modulation block or
+        // nullptr. Pairs share no state, so they can run on different threads.
+        void processPair(juce::AudioSampleBuffer &buffer, int pair, const float* modulation)
         {
-            auto* inputSamples = buffer.getReadPointer(channel);
-            auto* outputSamples = buffer.getWritePointer(channel);
+            auto channels = getChannelPair(buffer, pair);
             auto numSamples = buffer.getNumSamples();
 
-            float m = .0f;
-
-            for (int s = 0; s < numSamples; ++s)
-            {
-                if (modAmount > 0)
-                    m = (modOsc[channel].getNextSample() + 1) * modAmount;
-            
-                float delayedSample = delay[channel].popSample(channel, time + m);
-                float sampleToDelay = inputSamples[s] + dampFilter[channel].processSample(std::tanh((feedback * delayedSample)));
-                delay[channel].pushSample(channel, sampleToDelay);
-                outputSamples[s] = delayedSample;
-            }
+            withQuality(quality, [&] (auto tier) {
+                withFlag(modulation != nullptr && modAmount > 0, [&] (auto modulated) {
+                    withPairLayout(channels, [&] (auto stereo) {
+                        processFrames<decltype(tier)::value, decltype(modulated)::value, decltype(stereo)::value>(
+                            channels, pair, modulation, numSamples);
+                    });
+                });
+            });
         };
 
-        void setDelayTime(float delayTimeInMs)
+        void reset()
         {
-            auto delayTime = msToSamples(delayTimeInMs);
-            time = delayTime;
             for (auto& d : delay)
-                d.setDelay(time);
+                d.reset();
 
+            damping.reset();
         };
 
-        void setFeedback(float _feedback)
+        // Samples until an impulse has fallen below threshold: one trip
+        // through the line, plus one per feedback repeat. tanh and the
+        // damping filter only take level away, so this is an upper bound.
+        float getTailInSamples(float threshold) const
         {
-            feedback = _feedback;
+            auto repeats = feedback > 0.f ? std::ceil(std::log(threshold) / std::log(feedback)) : 0.f;
+            return (time + 2.f * modAmount) * (1.f + repeats);
         };
 
-        void setModFreq(float freq)
+        void setDelayTime(float delayTimeInMs)
+        {
+            time = msToSamples(delayTimeInMs);
+        };
+
+        void setFeedback(float _feedback)
         {
-            modFreq = freq;
-            for (auto& osc : modOsc)
-                osc.setFrequency(modFreq);
+            feedback = _feedback;
         };
 
         void setModAmount(float amount)
@@ -94,22 +102,58 @@ namespace Utils {
 
         void setDamp(float freq)
         {
-            filterCoef = juce::dsp::FilterDesign<float>::designFIRLowpassWindowMethod(freq, sampleRate, 21, juce::dsp::WindowingFunction<float>::hamming);
-            for(auto& f : dampFilter)
-                f.coefficients = filterCoef;
+            dampFreq = freq;
+            damping.setCutoff(dampFreq);
+        };
+
+        void setQuality(Quality newQuality)
+        {
+            if (newQuality == quality)
+                return;
+
+            quality = newQuality;
+            settings = QualitySettings::forTier(quality);
+            damping.setOrder(settings.dampingFilterOrder);
         };
 
     private:
         double sampleRate;
-        float feedback, time;
-        float modFreq, modAmount, modPhase;
-        std::vector<Utils::Sine> modOsc;
-        std::vector<juce::dsp::FIR::Filter<float>> dampFilter;
-        juce::dsp::FIR::Coefficients<float>::Ptr filterCoef;
-        std::vector<juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::Thiran>> delay;
+        float feedback, time{ 1.f };
+        float modAmount{ 20.f }, dampFreq{ 20000.f };
+        Quality quality{ Quality::high };
+        QualitySettings settings{ QualitySettings::forTier(Quality::high) };
+        DampingFilter damping;
+        std::vector<StereoRingBuffer> delay;
+
+        // The per-sample loop, one instantiation per tier, modulation and
+        // pair layout so none of them is tested inside it.
+        template <Quality Tier, bool Modulated, bool Stereo>
+        void processFrames(const ChannelPair& channels, int pair, const float* modulation, int numSamples)
+        {
+            constexpr auto tierSettings = QualitySettings::forTier(Tier);
+            auto& line = delay[static_cast<size_t>(pair)];
+
+            for (int s = 0; s < numSamples; ++s)
+            {
+                float m = .0f;
+                if constexpr (Modulated)
+                    m = (modulation[s] + 1) * modAmount;
+
+                auto delayedFrame = line.popFrame<tierSettings.interpolation>(time + m);
+
+                StereoFrame feedbackFrame;
+                if constexpr (tierSettings.fastMath)
+                    feedbackFrame = fastTanh(delayedFrame * feedback);
+                else
+                    feedbackFrame = exactTanh(delayedFrame * feedback);
+
+                line.pushFrame(channels.read<Stereo>(s) + damping.processFrame<tierSettings.dampingFilterOrder>(pair, feedbackFrame));
+                channels.write<Stereo>(s, delayedFrame);
+            }
+        };
 
         float msToSamples(float timeInMs) {
             return static_cast<float>(sampleRate) * timeInMs * 0.001f;
         }
     };
-}
\ No newline at end of file
+}
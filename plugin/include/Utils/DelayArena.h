@@ -0,0 +1,173 @@
+#pragma once
+
+#include "Utils/RingBuffer.h"
+#include "Utils/StageProfiler.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace Utils
+{
+    // Owns the sample memory of every delay line in the chain as one block.
+    // prepareToPlay() clears the arena, the DSP blocks prepare their lines and
+    // register them with add(), and allocate() carves the block into cache
+    // line aligned slices. The block is zero filled on allocation, so every
+    // page is touched before the first processBlock and not in it.
+    // Engines that never run at the same time can be registered as
+    // alternatives, see setAlternative(): they all start at the same
+    // address, so only the largest one takes memory.
+    class DelayArena
+    {
+    public:
+        static constexpr size_t alignment = 64;
+        static constexpr int always = -1;
+
+        DelayArena()
+        {};
+
+        ~DelayArena()
+        {};
+
+        // Forgets the registered lines, keeping the memory for the next layout.
+        void clear()
+        {
+            stereoLines.clear();
+            networkLines.clear();
+            alternative = always;
+        };
+
+        // Lines added from here on belong to the given alternative, numbered
+        // from 0, or to no alternative with always. Alternatives overlap, so
+        // whoever switches from one to another resets the lines it switches
+        // to before running them.
+        void setAlternative(int _alternative)
+        {
+            alternative = _alternative;
+        };
+
+        void add(Stage stage, StereoRingBuffer& line)
+        {
+            stereoLines.push_back({ &line, stage, alternative });
+        };
+
+        void add(Stage stage, NetworkRingBuffer& line)
+        {
+            networkLines.push_back({ &line, stage, alternative });
+        };
+
+        void allocate()
+        {
+            auto numAlternatives = std::max(getNumAlternatives(stereoLines), getNumAlternatives(networkLines));
+
+            // The lines every layout has, then room for the largest alternative
+            auto sharedFloats = getLayoutSize(stereoLines, always) + getLayoutSize(networkLines, always);
+            size_t alternativeFloats = 0;
+            for (int a = 0; a < numAlternatives; ++a)
+                alternativeFloats = std::max(alternativeFloats, getLayoutSize(stereoLines, a) + getLayoutSize(networkLines, a));
+
+            auto totalFloats = sharedFloats + alternativeFloats;
+
+            // Only grows, so preparing again at the same or a lower rate reuses it
+            if (totalFloats + alignmentInFloats > storage.size())
+                storage.assign(totalFloats + alignmentInFloats, 0.f);
+            else
+                std::fill(storage.begin(), storage.end(), 0.f);
+
+            auto address = reinterpret_cast<std::uintptr_t>(storage.data());
+            auto padding = (alignment - address % alignment) % alignment;
+            auto* base = storage.data() + padding / sizeof(float);
+
+            stageBytes.fill(0);
+            auto* alternativeBase = carve(networkLines, carve(stereoLines, base, always), always);
+            for (int a = 0; a < numAlternatives; ++a)
+                carve(networkLines, carve(stereoLines, alternativeBase, a), a);
+
+            totalBytes = totalFloats * sizeof(float);
+        };
+
+        // Delay memory handed to a stage's lines by the last allocate().
+        // Stages in different alternatives share theirs.
+        size_t getBytes(Stage stage) const
+        {
+            return stageBytes[static_cast<size_t>(stage)];
+        };
+
+        // The whole layout, alternatives counted once.
+        size_t getTotalBytes() const
+        {
+            return totalBytes;
+        };
+
+        // Memory held by the arena, including alignment padding and any
+        // headroom left from an earlier, larger layout.
+        size_t getReservedBytes() const
+        {
+            return storage.size() * sizeof(float);
+        };
+
+    private:
+        static constexpr size_t alignmentInFloats = alignment / sizeof(float);
+
+        template <typename Line>
+        struct Entry
+        {
+            Line* line;
+            Stage stage;
+            int alternative;
+        };
+
+        static size_t roundUp(size_t numFloats)
+        {
+            return (numFloats + alignmentInFloats - 1) / alignmentInFloats * alignmentInFloats;
+        };
+
+        template <typename Line>
+        static int getNumAlternatives(const std::vector<Entry<Line>>& entries)
+        {
+            int count = 0;
+            for (auto& e : entries)
+                count = std::max(count, e.alternative + 1);
+
+            return count;
+        };
+
+        template <typename Line>
+        static size_t getLayoutSize(const std::vector<Entry<Line>>& entries, int alternative)
+        {
+            size_t numFloats = 0;
+            for (auto& e : entries)
+                if (e.alternative == alternative)
+                    numFloats += roundUp(static_cast<size_t>(e.line->getCapacity()));
+
+            return numFloats;
+        };
+
+        // Hands the lines of one alternative consecutive slices starting at
+        // memory, returns the end.
+        template <typename Line>
+        float* carve(std::vector<Entry<Line>>& entries, float* memory, int alternative)
+        {
+            for (auto& e : entries)
+            {
+                if (e.alternative != alternative)
+                    continue;
+
+                auto capacity = static_cast<size_t>(e.line->getCapacity());
+                e.line->setMemory(memory);
+                stageBytes[static_cast<size_t>(e.stage)] += capacity * sizeof(float);
+                memory += roundUp(capacity);
+            }
+
+            return memory;
+        };
+
+        std::vector<Entry<StereoRingBuffer>> stereoLines;
+        std::vector<Entry<NetworkRingBuffer>> networkLines;
+        std::vector<float> storage;
+        std::array<size_t, static_cast<size_t>(Stage::numStages)> stageBytes{};
+        size_t totalBytes{ 0 };
+        int alternative{ always };
+    };
+}
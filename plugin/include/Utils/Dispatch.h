@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Utils/Quality.h"
+#include "Utils/StereoFrame.h"
+
+#include <type_traits>
+
+// Turns a runtime mode into a compile-time one. Each helper calls fn with a
+// std::integral_constant, so the loop inside fn is instantiated once per mode
+// and the choice is made once per call instead of once per sample.
+namespace Utils
+{
+    template <Quality Tier>
+    using QualityConstant = std::integral_constant<Quality, Tier>;
+
+    template <typename Fn>
+    void withFlag(bool flag, Fn&& fn)
+    {
+        if (flag)
+            fn(std::true_type{});
+        else
+            fn(std::false_type{});
+    }
+
+    template <typename Fn>
+    void withQuality(Quality quality, Fn&& fn)
+    {
+        switch (quality)
+        {
+            case Quality::eco:      fn(QualityConstant<Quality::eco>{}); return;
+            case Quality::standard: fn(QualityConstant<Quality::standard>{}); return;
+            case Quality::high:     break;
+        }
+
+        fn(QualityConstant<Quality::high>{});
+    }
+
+    // std::true_type for a pair with both channels, std::false_type for the
+    // lone last channel of an odd layout.
+    template <typename Fn>
+    void withPairLayout(const ChannelPair& channels, Fn&& fn)
+    {
+        withFlag(channels.right != nullptr, fn);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+
+#include <algorithm>
+
+// Branch free approximations that work both on plain floats and on
+// juce::dsp::SIMDRegister<float>, so the same code runs in scalar tails and in
+// the vectorised body of a block loop.
+namespace Utils
+{
+    using FloatRegister = juce::dsp::SIMDRegister<float>;
+
+    //==========================================================================
+    inline float clampValue(float x, float lower, float upper)
+    {
+        return std::min(std::max(x, lower), upper);
+    }
+
+    inline FloatRegister clampValue(FloatRegister x, float lower, float upper)
+    {
+        return FloatRegister::max(FloatRegister::expand(lower), FloatRegister::min(x, FloatRegister::expand(upper)));
+    }
+
+    inline float divide(float numerator, float denominator)
+    {
+        return numerator / denominator;
+    }
+
+    // SIMDRegister has no division operator, so go to the native register.
+    inline FloatRegister divide(FloatRegister numerator, FloatRegister denominator)
+    {
+       #if JUCE_USE_SSE_INTRINSICS && defined (__AVX2__)
+        return FloatRegister::fromNative(_mm256_div_ps(numerator.value, denominator.value));
+       #elif JUCE_USE_SSE_INTRINSICS
+        return FloatRegister::fromNative(_mm_div_ps(numerator.value, denominator.value));
+       #elif JUCE_USE_ARM_NEON && defined (__aarch64__)
+        return FloatRegister::fromNative(vdivq_f32(numerator.value, denominator.value));
+       #else
+        for (size_t i = 0; i < FloatRegister::SIMDNumElements; ++i)
+            numerator.set(i, numerator.get(i) / denominator.get(i));
+
+        return numerator;
+       #endif
+    }
+
+    //==========================================================================
+    // exp(x) for |x| <= 3: a 6th order Taylor series on x / 4, raised to the
+    // 4th power. Relative error is below 1.6e-6 for |x| <= 1.5 and grows to
+    // 2.1e-4 at x = -3, where the truncated series is furthest off.
+    template <typename T>
+    T fastExp(T x)
+    {
+        auto y = x * .25f;
+        auto p = y * (1.f / 720.f) + (1.f / 120.f);
+        p = p * y + (1.f / 24.f);
+        p = p * y + (1.f / 6.f);
+        p = p * y + .5f;
+        p = p * y + 1.f;
+        p = p * y + 1.f;
+        p = p * p;
+        return p * p;
+    }
+
+    // tanh(x) = (e^2x - 1) / (e^2x + 1), with e^2x from a 7th order Taylor
+    // series on x / 16 raised to the 32nd power. The input is clamped to
+    // +-9, where tanh is 1 to within float precision. Maximum absolute error
+    // against std::tanh is 1.7e-6.
+    template <typename T>
+    T fastTanh(T x)
+    {
+        auto y = clampValue(x, -9.f, 9.f) * (1.f / 16.f);
+        auto p = y * (1.f / 5040.f) + (1.f / 720.f);
+        p = p * y + (1.f / 120.f);
+        p = p * y + (1.f / 24.f);
+        p = p * y + (1.f / 6.f);
+        p = p * y + .5f;
+        p = p * y + 1.f;
+        p = p * y + 1.f;
+
+        for (int i = 0; i < 5; ++i)
+            p = p * p;
+
+        return divide(p - 1.f, p + 1.f);
+    }
+}
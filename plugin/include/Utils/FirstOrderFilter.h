@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Utils/Dispatch.h"
+#include "Utils/StereoFrame.h"
+
+#include <juce_dsp/juce_dsp.h>
+
+#include <array>
+#include <vector>
+
+namespace Utils
+{
+    // First order IIR that runs two channels per register. Takes the same
+    // coefficients as juce::dsp::IIR::Filter and the same transposed direct
+    // form II recursion, so it is a drop in for the one-pole tone and damping
+    // filters in the chain.
+    class FirstOrderFilter
+    {
+    public:
+        FirstOrderFilter()
+        {};
+
+        ~FirstOrderFilter()
+        {};
+
+        void prepare(int numChannels)
+        {
+            state.resize(static_cast<size_t>(getNumChannelPairs(numChannels)));
+            reset();
+        };
+
+        void reset()
+        {
+            for (auto& s : state)
+                s = StereoFrame::expand(0.f);
+        };
+
+        // { b0, b1, a0, a1 }, as returned by the makeFirstOrder* functions of
+        // juce::dsp::IIR::ArrayCoefficients.
+        void setCoefficients(const std::array<float, 4>& coefficients)
+        {
+            auto a0 = coefficients[2];
+            b0 = coefficients[0] / a0;
+            b1 = coefficients[1] / a0;
+            a1 = coefficients[3] / a0;
+        };
+
+        StereoFrame processFrame(int pair, StereoFrame x)
+        {
+            auto& z = state[static_cast<size_t>(pair)];
+            auto y = x * b0 + z;
+            z = x * b1 - y * a1;
+            return y;
+        };
+
+        void process(juce::AudioBuffer<float>& buffer)
+        {
+            for (int pair = 0; pair < getNumChannelPairs(buffer.getNumChannels()); ++pair)
+                processPair(buffer, pair);
+        };
+
+        void processPair(juce::AudioBuffer<float>& buffer, int pair)
+        {
+            auto numSamples = buffer.getNumSamples();
+            auto channels = getChannelPair(buffer, pair);
+
+            withPairLayout(channels, [&] (auto stereo) {
+                constexpr bool isStereo = decltype(stereo)::value;
+                for (int s = 0; s < numSamples; ++s)
+                    channels.write<isStereo>(s, processFrame(pair, channels.read<isStereo>(s)));
+            });
+        };
+
+    private:
+        std::vector<StereoFrame> state;
+        float b0{ 1.f }, b1{ 0.f }, a1{ 0.f };
+    };
+}
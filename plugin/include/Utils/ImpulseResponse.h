@@ -0,0 +1,420 @@
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_dsp/juce_dsp.h>
+
+#include <array>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace Utils
+{
+    // An impulse response cut into partitions for Utils::ConvolutionEngine.
+    // The first partition stays in the time domain, for the zero latency
+    // head; every later one is stored as the spectrum of a 2 * partitionSize
+    // real FFT, real parts then imaginary parts, so the multiply-adds run on
+    // contiguous arrays. It is resampled to the rate it will play at while
+    // it is built. Immutable once built and shared by every instance that
+    // loads the same file at the same rate.
+    class ImpulseResponse
+    {
+    public:
+        static constexpr double maxSeconds = 20.0;
+
+        int getPartitionSize() const { return partitionSize; };
+        int getNumBins() const { return partitionSize + 1; };
+        int getNumPartitions() const { return numPartitions; };
+        int getNumChannels() const { return static_cast<int>(heads.size()); };
+        int getLength() const { return length; };
+        double getSampleRate() const { return sampleRate; };
+
+        // partitionSize taps, in time order.
+        const float* getHead(int channel) const
+        {
+            return heads[static_cast<size_t>(channel)].data();
+        };
+
+        // Real parts of partition's spectrum, followed by getNumBins()
+        // imaginary parts. Partition 0 starts partitionSize samples into
+        // the response.
+        const float* getSpectrum(int channel, int partition) const
+        {
+            return spectra[static_cast<size_t>(channel)].data() + static_cast<size_t>(partition) * 2 * static_cast<size_t>(getNumBins());
+        };
+
+        // Loads file, resampled to sampleRate, and transforms it, or returns
+        // the copy another instance already made. Reads the file a partition
+        // at a time, from a memory map where the format allows it, so only
+        // the transformed partitions stay in memory. Slow: call it from a
+        // background thread. Returns nullptr when the file cannot be read.
+        static std::shared_ptr<const ImpulseResponse> load(const juce::File& file, int partitionSize, double sampleRate)
+        {
+            static juce::CriticalSection cacheLock;
+            static std::map<juce::String, std::weak_ptr<const ImpulseResponse>> cache;
+
+            auto key = file.getFullPathName() + "|" + juce::String(partitionSize) + "|" + juce::String(sampleRate)
+                     + "|" + juce::String(file.getLastModificationTime().toMilliseconds());
+
+            const juce::ScopedLock lock(cacheLock);
+
+            // Forget the responses no instance holds any more
+            for (auto entry = cache.begin(); entry != cache.end();)
+                entry = entry->second.expired() ? cache.erase(entry) : std::next(entry);
+
+            auto entry = cache.find(key);
+            if (entry != cache.end())
+                if (auto cached = entry->second.lock())
+                    return cached;
+
+            std::shared_ptr<const ImpulseResponse> response(build(file, partitionSize, sampleRate).release());
+            if (response != nullptr)
+                cache[key] = response;
+
+            return response;
+        };
+
+    private:
+        ImpulseResponse()
+        {};
+
+        static std::unique_ptr<juce::AudioFormatReader> createReader(const juce::File& file)
+        {
+            juce::AudioFormatManager formats;
+            formats.registerBasicFormats();
+
+            if (auto* format = formats.findFormatForFileExtension(file.getFileExtension()))
+            {
+                std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(format->createMemoryMappedReader(file));
+                if (mapped != nullptr && mapped->mapEntireFile())
+                    return mapped;
+            }
+
+            // Formats that cannot be mapped are still only read a partition at a time
+            return std::unique_ptr<juce::AudioFormatReader>(formats.createReaderFor(file));
+        };
+
+        static std::unique_ptr<ImpulseResponse> build(const juce::File& file, int partitionSize, double sampleRate)
+        {
+            auto reader = createReader(file);
+            if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0)
+                return nullptr;
+
+            std::unique_ptr<ImpulseResponse> response(new ImpulseResponse());
+            auto numChannels = juce::jlimit(1, 2, static_cast<int>(reader->numChannels));
+            auto ratio = reader->sampleRate / sampleRate;
+            auto sourceLength = juce::jmin(reader->lengthInSamples, static_cast<juce::int64>(reader->sampleRate * maxSeconds));
+            auto length = static_cast<int>(std::ceil(static_cast<double>(sourceLength) / ratio));
+
+            response->partitionSize = partitionSize;
+            response->length = length;
+            response->sampleRate = sampleRate;
+            response->numPartitions = juce::jmax(0, (length - 1) / partitionSize);
+
+            // The partitions are read in order. A file at another rate goes
+            // through a resampler, which low passes it first when it has to
+            // drop the rate.
+            juce::AudioFormatReaderSource source(reader.get(), false);
+            std::unique_ptr<juce::ResamplingAudioSource> resampler;
+            if (ratio != 1.0)
+            {
+                resampler = std::make_unique<juce::ResamplingAudioSource>(&source, false, numChannels);
+                resampler->setResamplingRatio(ratio);
+                resampler->prepareToPlay(partitionSize, sampleRate);
+            }
+
+            juce::AudioBuffer<float> partition(numChannels, partitionSize);
+            auto readPartition = [&] (int index) {
+                partition.clear();
+                auto start = index * partitionSize;
+                auto count = juce::jmin(partitionSize, length - start);
+
+                if (resampler != nullptr)
+                    resampler->getNextAudioBlock(juce::AudioSourceChannelInfo(&partition, 0, count));
+                else
+                    reader->read(&partition, 0, count, start, true, numChannels > 1);
+            };
+
+            juce::dsp::FFT fft(juce::roundToInt(std::log2(2 * partitionSize)));
+            std::vector<float> transform(static_cast<size_t>(4 * partitionSize));
+            auto numBins = response->getNumBins();
+
+            response->heads.assign(static_cast<size_t>(numChannels), std::vector<float>(static_cast<size_t>(partitionSize)));
+            response->spectra.assign(static_cast<size_t>(numChannels),
+                                     std::vector<float>(static_cast<size_t>(response->numPartitions) * 2 * static_cast<size_t>(numBins)));
+
+            // One pass, so the resampler runs once: each partition is kept
+            // or transformed as it comes in, and everything is scaled once
+            // the energy of the whole response is known
+            for (int p = 0; p <= response->numPartitions; ++p)
+            {
+                readPartition(p);
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    auto* data = partition.getReadPointer(channel);
+                    double sum = 0.0;
+                    for (int s = 0; s < partitionSize; ++s)
+                        sum += static_cast<double>(data[s]) * data[s];
+
+                    response->channelEnergy[static_cast<size_t>(channel)] += sum;
+
+                    if (p == 0)
+                    {
+                        std::copy(data, data + partitionSize, response->heads[static_cast<size_t>(channel)].begin());
+                        continue;
+                    }
+
+                    // Zero padded to twice the partition, for overlap-save
+                    std::fill(transform.begin(), transform.end(), 0.f);
+                    std::copy(data, data + partitionSize, transform.begin());
+                    fft.performRealOnlyForwardTransform(transform.data(), true);
+
+                    auto* spectrum = response->spectra[static_cast<size_t>(channel)].data() + static_cast<size_t>(p - 1) * 2 * static_cast<size_t>(numBins);
+                    for (int k = 0; k < numBins; ++k)
+                    {
+                        spectrum[k] = transform[static_cast<size_t>(2 * k)];
+                        spectrum[numBins + k] = transform[static_cast<size_t>(2 * k + 1)];
+                    }
+                }
+            }
+
+            // Unit energy in the louder channel, so the wet level does not
+            // depend on how hot the file was recorded. The transform is
+            // linear, so the spectra scale with the samples.
+            double energy = 0.0;
+            for (int channel = 0; channel < numChannels; ++channel)
+                energy = juce::jmax(energy, response->channelEnergy[static_cast<size_t>(channel)]);
+
+            auto gain = energy > 0.0 ? static_cast<float>(1.0 / std::sqrt(energy)) : 0.f;
+            for (auto& head : response->heads)
+                juce::FloatVectorOperations::multiply(head.data(), gain, partitionSize);
+            for (auto& spectrum : response->spectra)
+                juce::FloatVectorOperations::multiply(spectrum.data(), gain, static_cast<int>(spectrum.size()));
+
+            return response;
+        };
+
+        int partitionSize{ 0 }, numPartitions{ 0 }, length{ 0 };
+        double sampleRate{ 44100.0 };
+        std::array<double, 2> channelEnergy{};
+        std::vector<std::vector<float>> heads, spectra;
+    };
+
+    // Uniformly partitioned convolution with one impulse response, for every
+    // channel of a buffer. The first partition runs in the time domain, so
+    // the output has no latency; the rest is overlap-save on FFTs of twice
+    // the partition size, with the input spectra kept in a frequency domain
+    // delay line. The older partitions only need inputs that are already in
+    // the delay line, so their multiply-adds are spread over the period as
+    // it fills; the boundary is left with the two FFTs and the newest
+    // partition. Allocates only in its constructor.
+    class ConvolutionEngine
+    {
+    public:
+        ConvolutionEngine(std::shared_ptr<const ImpulseResponse> _response, int numChannels)
+            : response(std::move(_response)),
+              partitionSize(response->getPartitionSize()),
+              numBins(response->getNumBins()),
+              numPartitions(response->getNumPartitions()),
+              fft(juce::roundToInt(std::log2(2 * partitionSize)))
+        {
+            auto slotSize = static_cast<size_t>(2 * numBins);
+            auto blockSize = static_cast<size_t>(partitionSize);
+
+            channels.resize(static_cast<size_t>(numChannels));
+            for (auto& c : channels)
+            {
+                c.history.assign(2 * blockSize, 0.f);
+                c.input.assign(blockSize, 0.f);
+                c.previousInput.assign(blockSize, 0.f);
+                c.tail.assign(blockSize, 0.f);
+                c.delayLine.assign(static_cast<size_t>(juce::jmax(1, numPartitions)) * slotSize, 0.f);
+                c.accumulator.assign(slotSize, 0.f);
+            }
+
+            transform.assign(static_cast<size_t>(4 * partitionSize), 0.f);
+        };
+
+        void reset()
+        {
+            for (auto& c : channels)
+            {
+                std::fill(c.history.begin(), c.history.end(), 0.f);
+                std::fill(c.input.begin(), c.input.end(), 0.f);
+                std::fill(c.previousInput.begin(), c.previousInput.end(), 0.f);
+                std::fill(c.tail.begin(), c.tail.end(), 0.f);
+                std::fill(c.delayLine.begin(), c.delayLine.end(), 0.f);
+                std::fill(c.accumulator.begin(), c.accumulator.end(), 0.f);
+            }
+
+            filled = 0;
+            delayLinePos = 0;
+            nextPartition = 1;
+        };
+
+        int getLength() const { return response->getLength(); };
+
+        // Replaces every channel of buffer with its convolution. A mono
+        // response is used on every channel, a stereo one left and right.
+        void process(juce::AudioBuffer<float>& buffer)
+        {
+            auto numSamples = buffer.getNumSamples();
+            auto numChannels = juce::jmin(buffer.getNumChannels(), static_cast<int>(channels.size()));
+
+            for (int done = 0; done < numSamples;)
+            {
+                auto chunk = juce::jmin(numSamples - done, partitionSize - filled);
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                    processHead(channels[static_cast<size_t>(channel)], getResponseChannel(channel), buffer.getWritePointer(channel, done), chunk);
+
+                filled += chunk;
+                done += chunk;
+
+                // The share of the older partitions this much of the period owes
+                accumulatePartitions(numChannels, 1 + (numPartitions - 1) * filled / partitionSize);
+
+                if (filled == partitionSize)
+                {
+                    processPartitions(numChannels);
+                    filled = 0;
+                }
+            }
+        };
+
+    private:
+        struct Channel
+        {
+            // The last partitionSize - 1 inputs, then the current chunk
+            std::vector<float> history;
+            std::vector<float> input, previousInput, tail;
+            std::vector<float> delayLine;
+            // The next output spectrum, built up over the period
+            std::vector<float> accumulator;
+        };
+
+        int getResponseChannel(int channel) const
+        {
+            return channel % response->getNumChannels();
+        };
+
+        // Direct form FIR with the first partition, plus what the partitions
+        // computed for this stretch of the block
+        void processHead(Channel& c, int responseChannel, float* data, int chunk)
+        {
+            auto past = static_cast<size_t>(partitionSize - 1);
+            std::copy(data, data + chunk, c.history.begin() + static_cast<std::ptrdiff_t>(past));
+            std::copy(data, data + chunk, c.input.begin() + filled);
+            std::copy(c.tail.begin() + filled, c.tail.begin() + filled + chunk, data);
+
+            // One vectorised pass per tap over the chunk
+            auto* head = response->getHead(responseChannel);
+            auto* x = c.history.data() + past;
+            for (int tap = 0; tap < partitionSize; ++tap)
+                juce::FloatVectorOperations::addWithMultiply(data, x - tap, head[tap], chunk);
+
+            std::copy(c.history.begin() + chunk, c.history.begin() + chunk + static_cast<std::ptrdiff_t>(past), c.history.begin());
+        };
+
+        // Partitions [nextPartition, end) against the inputs they will line
+        // up with at the next boundary, which are all in the delay line.
+        void accumulatePartitions(int numChannels, int end)
+        {
+            if (end <= nextPartition)
+                return;
+
+            auto slotSize = static_cast<size_t>(2 * numBins);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto& c = channels[static_cast<size_t>(channel)];
+                auto responseChannel = getResponseChannel(channel);
+                auto* accRe = c.accumulator.data();
+                auto* accIm = accRe + numBins;
+
+                for (int p = nextPartition; p < end; ++p)
+                {
+                    auto slot = (delayLinePos + 1 - p + numPartitions) % numPartitions;
+                    auto* x = c.delayLine.data() + static_cast<size_t>(slot) * slotSize;
+                    auto* h = response->getSpectrum(responseChannel, p);
+                    multiplyAdd(x, x + numBins, h, h + numBins, accRe, accIm, numBins);
+                }
+            }
+
+            nextPartition = end;
+        };
+
+        void processPartitions(int numChannels)
+        {
+            if (numPartitions == 0)
+                return;
+
+            accumulatePartitions(numChannels, numPartitions);
+
+            delayLinePos = (delayLinePos + 1) % numPartitions;
+            auto slotSize = static_cast<size_t>(2 * numBins);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto& c = channels[static_cast<size_t>(channel)];
+                auto responseChannel = getResponseChannel(channel);
+
+                // Spectrum of the last two input partitions, into the delay line
+                std::fill(transform.begin(), transform.end(), 0.f);
+                std::copy(c.previousInput.begin(), c.previousInput.end(), transform.begin());
+                std::copy(c.input.begin(), c.input.end(), transform.begin() + partitionSize);
+                std::swap(c.previousInput, c.input);
+                fft.performRealOnlyForwardTransform(transform.data(), true);
+
+                auto* newest = c.delayLine.data() + static_cast<size_t>(delayLinePos) * slotSize;
+                for (int k = 0; k < numBins; ++k)
+                {
+                    newest[k] = transform[static_cast<size_t>(2 * k)];
+                    newest[numBins + k] = transform[static_cast<size_t>(2 * k + 1)];
+                }
+
+                // The newest partition is all that is left
+                auto* accRe = c.accumulator.data();
+                auto* accIm = accRe + numBins;
+                auto* h = response->getSpectrum(responseChannel, 0);
+                multiplyAdd(newest, newest + numBins, h, h + numBins, accRe, accIm, numBins);
+
+                for (int k = 0; k < numBins; ++k)
+                {
+                    transform[static_cast<size_t>(2 * k)] = accRe[k];
+                    transform[static_cast<size_t>(2 * k + 1)] = accIm[k];
+                }
+
+                std::fill(c.accumulator.begin(), c.accumulator.end(), 0.f);
+
+                fft.performRealOnlyInverseTransform(transform.data());
+
+                // Overlap-save keeps the second half. It belongs one
+                // partition later, which is where partition 0 starts.
+                std::copy(transform.begin() + partitionSize, transform.begin() + 2 * partitionSize, c.tail.begin());
+            }
+
+            nextPartition = 1;
+        };
+
+        // acc += x * h over split complex arrays. No loop carried state, so
+        // the compiler vectorises it.
+        static void multiplyAdd(const float* xRe, const float* xIm, const float* hRe, const float* hIm,
+                                float* accRe, float* accIm, int numBins)
+        {
+            for (int k = 0; k < numBins; ++k)
+            {
+                accRe[k] += xRe[k] * hRe[k] - xIm[k] * hIm[k];
+                accIm[k] += xRe[k] * hIm[k] + xIm[k] * hRe[k];
+            }
+        };
+
+        std::shared_ptr<const ImpulseResponse> response;
+        int partitionSize, numBins, numPartitions;
+        juce::dsp::FFT fft;
+
+        std::vector<Channel> channels;
+        std::vector<float> transform;
+        int filled{ 0 }, delayLinePos{ 0 }, nextPartition{ 1 };
+    };
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "Utils/Modulation.h"
+
+#include <juce_dsp/juce_dsp.h>
+
+#include <cmath>
+
+namespace Utils
+{
+    // Sine oscillator built on a rotating (cos, sin) pair: each sample costs
+    // four multiplies instead of a call to std::sin. The state is kept in
+    // double and renormalised every renormaliseInterval samples, so the
+    // amplitude cannot drift. The interval counts samples, not calls, so the
+    // output does not depend on how the blocks are cut.
+    // Starts at phase 0 and outputs sin(phase) before advancing, like Utils::Sine.
+    class QuadratureOscillator
+    {
+    public:
+        static constexpr int renormaliseInterval = 64;
+
+        QuadratureOscillator()
+        {};
+
+        ~QuadratureOscillator()
+        {};
+
+        void prepare(double _sampleRate)
+        {
+            sampleRate = _sampleRate;
+            reset();
+            updateIncrement();
+        };
+
+        void reset()
+        {
+            sinState = 0.0;
+            cosState = 1.0;
+            sinceRenormalise = 0;
+        };
+
+        void setFrequency(float freq)
+        {
+            if (freq != frequency)
+            {
+                frequency = freq;
+                updateIncrement();
+            }
+        };
+
+        // quadrature, when given, gets cos(phase) for each sample as well.
+        void process(float* output, float* quadrature, int numSamples)
+        {
+            for (int s = 0; s < numSamples; ++s)
+            {
+                output[s] = static_cast<float>(sinState);
+                if (quadrature != nullptr)
+                    quadrature[s] = static_cast<float>(cosState);
+
+                auto nextSin = sinState * cosDelta + cosState * sinDelta;
+                cosState = cosState * cosDelta - sinState * sinDelta;
+                sinState = nextSin;
+
+                if (++sinceRenormalise == renormaliseInterval)
+                {
+                    auto gain = 1.0 / std::sqrt(sinState * sinState + cosState * cosState);
+                    sinState *= gain;
+                    cosState *= gain;
+                    sinceRenormalise = 0;
+                }
+            }
+        };
+
+    private:
+        double sampleRate{ 44100.0 };
+        double sinState{ 0.0 }, cosState{ 1.0 }, sinDelta{ 0.0 }, cosDelta{ 1.0 };
+        float frequency{ 0.f };
+        int sinceRenormalise{ 0 };
+
+        void updateIncrement()
+        {
+            auto angleDelta = juce::MathConstants<double>::twoPi * frequency / sampleRate;
+            sinDelta = std::sin(angleDelta);
+            cosDelta = std::cos(angleDelta);
+        };
+    };
+
+    // A fixed set of modulation oscillators rendered a whole block at a time.
+    // Consumers that run at the same rate read the same voice and apply their
+    // own depth and sign, so adding consumers costs nothing extra. With more
+    // than one channel pair, every voice is also rendered once per pair, with
+    // the phases spread evenly round the circle. The rotated copies come from
+    // the sine and cosine the oscillator already has, so they cost two
+    // multiplies and an add per sample, and the first pair keeps the plain
+    // sine, exactly as with a single pair.
+    class LfoBank
+    {
+    public:
+        LfoBank()
+        {};
+
+        ~LfoBank()
+        {};
+
+        void prepare(double sampleRate, int maxBlockSize, int numVoices, int _numPairs = 1)
+        {
+            numPairs = juce::jmax(1, _numPairs);
+
+            voices.resize(static_cast<size_t>(numVoices));
+            for (auto& v : voices)
+                v.prepare(sampleRate);
+
+            blocks.setSize(numVoices * numPairs, maxBlockSize);
+            blocks.clear();
+            quadrature.setSize(numPairs > 1 ? 1 : 0, maxBlockSize);
+
+            phaseOffsets.resize(static_cast<size_t>(numPairs));
+            for (int pair = 0; pair < numPairs; ++pair)
+            {
+                auto angle = juce::MathConstants<double>::twoPi * pair / numPairs;
+                phaseOffsets[static_cast<size_t>(pair)] = { static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)) };
+            }
+        };
+
+        void reset()
+        {
+            for (auto& v : voices)
+                v.reset();
+        };
+
+        void setFrequency(int voice, float freq)
+        {
+            voices[static_cast<size_t>(voice)].setFrequency(freq);
+        };
+
+        // Renders the next numSamples of every voice, and of every pair.
+        void process(int numSamples)
+        {
+            blocks.setSize(blocks.getNumChannels(), numSamples, false, false, true);
+            for (int v = 0; v < static_cast<int>(voices.size()); ++v)
+            {
+                auto* sine = blocks.getWritePointer(v * numPairs);
+                auto* cosine = numPairs > 1 ? quadrature.getWritePointer(0) : nullptr;
+                voices[static_cast<size_t>(v)].process(sine, cosine, numSamples);
+
+                // sin(phase + offset) = sin * cos(offset) + cos * sin(offset)
+                for (int pair = 1; pair < numPairs; ++pair)
+                {
+                    auto& offset = phaseOffsets[static_cast<size_t>(pair)];
+                    auto* rotated = blocks.getWritePointer(v * numPairs + pair);
+                    juce::FloatVectorOperations::multiply(rotated, sine, offset.cosine, numSamples);
+                    juce::FloatVectorOperations::addWithMultiply(rotated, cosine, offset.sine, numSamples);
+                }
+            }
+        };
+
+        // The first pair's block.
+        const float* getBlock(int voice) const
+        {
+            return blocks.getReadPointer(voice * numPairs);
+        };
+
+        // Every pair's block, for the stages that run channel pairs.
+        Modulation getModulation(int voice) const
+        {
+            return { blocks.getArrayOfReadPointers() + voice * numPairs, numPairs };
+        };
+
+    private:
+        struct PhaseOffset
+        {
+            float cosine, sine;
+        };
+
+        std::vector<QuadratureOscillator> voices;
+        juce::AudioBuffer<float> blocks, quadrature;
+        std::vector<PhaseOffset> phaseOffsets;
+        int numPairs{ 1 };
+    };
+}
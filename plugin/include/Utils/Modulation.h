@@ -0,0 +1,33 @@
+#pragma once
+
+namespace Utils
+{
+    // One block of an LFO voice as the stages read it: either a single block
+    // every channel pair shares, or one block per pair, each at its own
+    // phase, so the pairs of a surround bus do not all move together. Within
+    // a pair the stages still apply their own sign per lane. Empty when the
+    // stage is not modulated.
+    class Modulation
+    {
+    public:
+        Modulation(const float* shared = nullptr) : sharedBlock(shared)
+        {};
+
+        Modulation(const float* const* _pairBlocks, int _numPairBlocks)
+            : pairBlocks(_pairBlocks), numPairBlocks(_numPairBlocks)
+        {};
+
+        bool isActive() const { return sharedBlock != nullptr || pairBlocks != nullptr; };
+
+        // Pairs past the last block wrap round to the first ones.
+        const float* forPair(int pair) const
+        {
+            return pairBlocks != nullptr ? pairBlocks[pair % numPairBlocks] : sharedBlock;
+        };
+
+    private:
+        const float* sharedBlock{ nullptr };
+        const float* const* pairBlocks{ nullptr };
+        int numPairBlocks{ 0 };
+    };
+}
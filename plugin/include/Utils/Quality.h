@@ -0,0 +1,44 @@
+#pragma once
+
+namespace Utils
+{
+    // Processing quality tiers, in order of increasing cost. The value of the
+    // QUALITY_ID choice parameter maps straight onto this enum.
+    enum class Quality
+    {
+        eco,
+        standard,
+        high
+    };
+
+    static constexpr int numQualityTiers = 3;
+
+    // Fractional delay read kernels, see Utils::StereoRingBuffer.
+    enum class Interpolation
+    {
+        linear,
+        lagrange3,
+        sinc
+    };
+
+    // What a tier changes in the DSP blocks. Parameter ranges and the overall
+    // sound stay the same, only the precision of the building blocks moves.
+    struct QualitySettings
+    {
+        Interpolation interpolation;
+        int dampingFilterOrder;
+        bool fastMath;
+
+        static constexpr QualitySettings forTier(Quality quality)
+        {
+            switch (quality)
+            {
+                case Quality::eco:      return { Interpolation::linear, 1, true };
+                case Quality::standard: return { Interpolation::lagrange3, 2, true };
+                case Quality::high:     break;
+            }
+
+            return { Interpolation::sinc, 2, false };
+        }
+    };
+}
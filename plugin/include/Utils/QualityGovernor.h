@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Utils/Quality.h"
+
+#include <juce_core/juce_core.h>
+
+namespace Utils
+{
+    // Watches how much of each block's deadline processBlock uses and caps
+    // the quality tier when the load stays high. The cap is lifted one tier at
+    // a time after a long quiet stretch, so it does not flip back and forth.
+    class QualityGovernor
+    {
+    public:
+        QualityGovernor()
+        {};
+
+        ~QualityGovernor()
+        {};
+
+        void reset()
+        {
+            cap = Quality::high;
+            pressureSeconds = 0.0;
+            reliefSeconds = 0.0;
+        };
+
+        // Share of the block deadline above which a block counts as pressure,
+        // and below which it counts as relief.
+        void setThresholds(double stepDownLoad, double stepUpLoad)
+        {
+            highLoad = stepDownLoad;
+            lowLoad = stepUpLoad;
+        };
+
+        void addBlock(juce::int64 elapsedTicks, int numSamples, double sampleRate)
+        {
+            if (numSamples <= 0 || sampleRate <= 0.0)
+                return;
+
+            auto deadline = numSamples / sampleRate;
+            auto load = juce::Time::highResolutionTicksToSeconds(elapsedTicks) / deadline;
+
+            if (load > highLoad)
+            {
+                pressureSeconds += deadline;
+                reliefSeconds = 0.0;
+            }
+            else if (load < lowLoad)
+            {
+                reliefSeconds += deadline;
+                pressureSeconds = 0.0;
+            }
+            else
+            {
+                pressureSeconds = 0.0;
+                reliefSeconds = 0.0;
+            }
+
+            if (pressureSeconds >= pressureTime && cap != Quality::eco)
+            {
+                cap = static_cast<Quality>(static_cast<int>(cap) - 1);
+                pressureSeconds = 0.0;
+            }
+            else if (reliefSeconds >= reliefTime && cap != Quality::high)
+            {
+                cap = static_cast<Quality>(static_cast<int>(cap) + 1);
+                reliefSeconds = 0.0;
+            }
+        };
+
+        // The tier to run: the user's choice, unless the governor capped it.
+        Quality limit(Quality selected) const
+        {
+            return static_cast<int>(selected) < static_cast<int>(cap) ? selected : cap;
+        };
+
+        Quality getCap() const { return cap; };
+
+    private:
+        static constexpr double pressureTime = .25, reliefTime = 5.0;
+
+        Quality cap{ Quality::high };
+        double highLoad{ .25 }, lowLoad{ .08 };
+        double pressureSeconds{ 0.0 }, reliefSeconds{ 0.0 };
+    };
+}
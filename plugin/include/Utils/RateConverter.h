@@ -0,0 +1,301 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace Utils
+{
+    // Halfband low pass for the 2x stages of RateConverter: a windowed sinc
+    // cut at a quarter of the higher rate. Every other tap of a halfband is
+    // zero and the centre one is 1/2, so only the odd taps either side of
+    // the centre are kept, and the polyphase loops below touch just those.
+    struct HalfbandKernel
+    {
+        // Non zero taps on each side of the centre; 4 * numSideTaps - 1 taps
+        // in all. Flat to 0.1 dB up to about 0.2 of the higher rate, 19.8 kHz
+        // at 96 kHz, and 74 dB down from 0.31 of it.
+        static constexpr int numSideTaps = 12;
+        static constexpr int centre = 2 * numSideTaps - 1;
+
+        // Tap at centre +-(2k + 1), for k in [0, numSideTaps).
+        std::array<float, numSideTaps> taps{};
+
+        HalfbandKernel()
+        {
+            // Blackman window over the whole length, then normalised so the
+            // response at DC is exactly one
+            constexpr auto length = 2 * centre + 1;
+            auto sum = 0.0;
+            for (int k = 0; k < numSideTaps; ++k)
+            {
+                auto offset = 2 * k + 1;
+                auto x = juce::MathConstants<double>::pi * offset * .5;
+                auto n = static_cast<double>(centre + offset) / (length - 1);
+                auto window = .42 - .5 * std::cos(juce::MathConstants<double>::twoPi * n) + .08 * std::cos(2.0 * juce::MathConstants<double>::twoPi * n);
+                auto tap = .5 * std::sin(x) / x * window;
+
+                taps[static_cast<size_t>(k)] = static_cast<float>(tap);
+                sum += tap;
+            }
+
+            for (auto& t : taps)
+                t = static_cast<float>(t * .25 / sum);
+        };
+
+        static const HalfbandKernel& get()
+        {
+            static const HalfbandKernel kernel;
+            return kernel;
+        };
+    };
+
+    // Halves the rate of one channel. Takes any number of samples: an odd
+    // one out waits for the next call.
+    class HalfbandDecimator
+    {
+    public:
+        void prepare(int maxInputSamples)
+        {
+            history.assign(static_cast<size_t>(historySize + maxInputSamples + 1), 0.f);
+            reset();
+        };
+
+        void reset()
+        {
+            std::fill(history.begin(), history.end(), 0.f);
+            filled = historySize;
+        };
+
+        // Returns the number of samples written to output.
+        int process(const float* input, int numSamples, float* output)
+        {
+            auto& taps = HalfbandKernel::get().taps;
+            auto* x = history.data();
+
+            std::copy(input, input + numSamples, x + filled);
+            filled += numSamples;
+
+            // Each output is centred on an even sample, with the odd taps
+            // folded pairwise round it
+            int numOutputs = 0;
+            int newest = historySize;
+            for (; newest < filled; newest += 2)
+            {
+                auto* c = x + newest - HalfbandKernel::centre;
+                auto y = .5f * *c;
+                for (int k = 0; k < HalfbandKernel::numSideTaps; ++k)
+                    y += taps[static_cast<size_t>(k)] * (c[-(2 * k + 1)] + c[2 * k + 1]);
+
+                output[numOutputs++] = y;
+            }
+
+            // Keep the window the next output needs. That output may fall on
+            // the first sample of the next call, so filled can end up one
+            // short of historySize.
+            auto keepFrom = newest - historySize;
+            std::copy(x + keepFrom, x + filled, x);
+            filled -= keepFrom;
+            return numOutputs;
+        };
+
+    private:
+        static constexpr int historySize = 2 * HalfbandKernel::centre;
+        std::vector<float> history;
+        int filled{ historySize };
+    };
+
+    // Doubles the rate of one channel: two outputs per input.
+    class HalfbandInterpolator
+    {
+    public:
+        void prepare(int maxInputSamples)
+        {
+            history.assign(static_cast<size_t>(historySize + maxInputSamples), 0.f);
+            reset();
+        };
+
+        void reset()
+        {
+            std::fill(history.begin(), history.end(), 0.f);
+        };
+
+        void process(const float* input, int numSamples, float* output)
+        {
+            auto& taps = HalfbandKernel::get().taps;
+            auto* x = history.data();
+            std::copy(input, input + numSamples, x + historySize);
+
+            // Zero stuffing leaves the odd outputs with only the centre tap,
+            // and the even ones with only the odd taps. Both are doubled to
+            // make up for the zeros.
+            constexpr auto half = HalfbandKernel::numSideTaps;
+            for (int i = 0; i < numSamples; ++i)
+            {
+                auto* a = x + historySize + i - half + 1;
+
+                auto even = 0.f;
+                for (int k = 0; k < half; ++k)
+                    even += taps[static_cast<size_t>(k)] * (a[k] + a[-1 - k]);
+
+                output[2 * i] = 2.f * even;
+                output[2 * i + 1] = *a;
+            }
+
+            std::copy(x + numSamples, x + numSamples + historySize, x);
+        };
+
+    private:
+        static constexpr int historySize = 2 * HalfbandKernel::numSideTaps - 1;
+        std::vector<float> history;
+    };
+
+    // Runs part of the chain at a lower internal rate. down() takes a block
+    // at the host rate to the internal rate through cascaded halfband
+    // stages, and up() brings the result back. A host block whose length is
+    // not a multiple of the factor gives one internal sample more or less
+    // than its share. So up() queues its output, primed with factor - 1
+    // samples of silence, and hands back exactly the host's block size each
+    // time. The round trip delays the signal by a fixed number of host
+    // samples, which only the wet path ever sees.
+    class RateConverter
+    {
+    public:
+        static constexpr int maxFactor = 4;
+
+        RateConverter()
+        {};
+
+        ~RateConverter()
+        {};
+
+        // The largest power of two, up to maxFactor, that keeps the internal
+        // rate at 44.1 kHz or more.
+        static int getFactorFor(double sampleRate)
+        {
+            int factor = 1;
+            while (factor < maxFactor && sampleRate / (2 * factor) >= 44100.0)
+                factor *= 2;
+
+            return factor;
+        };
+
+        // factor 1 leaves the converter inactive and the chain at the host
+        // rate. Allocates, so call it from prepareToPlay.
+        void prepare(int numChannels, int maxBlockSize, int _factor)
+        {
+            factor = _factor;
+            numStages = factor == 4 ? 2 : factor == 2 ? 1 : 0;
+
+            auto numStageChannels = static_cast<size_t>(numChannels * numStages);
+            decimators.resize(numStageChannels);
+            interpolators.resize(numStageChannels);
+            for (auto& d : decimators)
+                d.prepare(maxBlockSize + 2);
+
+            for (auto& i : interpolators)
+                i.prepare(maxBlockSize + 2);
+
+            maxInternalBlockSize = isActive() ? maxBlockSize / factor + 1 : maxBlockSize;
+            internal.setSize(numChannels, maxInternalBlockSize);
+            scratch.setSize(numChannels, maxBlockSize + 2 * factor);
+            queue.setSize(numChannels, maxBlockSize + 2 * factor);
+            reset();
+        };
+
+        void reset()
+        {
+            for (auto& d : decimators)
+                d.reset();
+
+            for (auto& i : interpolators)
+                i.reset();
+
+            internal.clear();
+            queue.clear();
+            queued = factor - 1;
+        };
+
+        bool isActive() const { return factor > 1; };
+        int getFactor() const { return factor; };
+        int getMaxInternalBlockSize() const { return maxInternalBlockSize; };
+
+        // Brings input to the internal rate and returns it. The buffer stays
+        // valid until the next call to down().
+        juce::AudioBuffer<float>& down(const juce::AudioBuffer<float>& input)
+        {
+            auto numChannels = internal.getNumChannels();
+            auto numSamples = input.getNumSamples();
+            jassert(numSamples <= scratch.getNumSamples() - 2 * factor);
+
+            // Every channel comes out the same length, but resizing moves the
+            // channels of a buffer, so the stages work in scratch and the
+            // result is copied once the length is known
+            int numInternal = 0;
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto* work = scratch.getWritePointer(channel);
+                auto* stageInput = input.getReadPointer(channel);
+                auto stageSamples = numSamples;
+
+                // Stages take a copy of their input first, so they can write
+                // over it
+                for (int stage = 0; stage < numStages; ++stage)
+                {
+                    stageSamples = decimators[static_cast<size_t>(stage * numChannels + channel)].process(stageInput, stageSamples, work);
+                    stageInput = work;
+                }
+
+                numInternal = stageSamples;
+            }
+
+            internal.setSize(numChannels, numInternal, false, false, true);
+            for (int channel = 0; channel < numChannels; ++channel)
+                internal.copyFrom(channel, 0, scratch, channel, 0, numInternal);
+
+            return internal;
+        };
+
+        // Brings what the chain made of the last down() back to the host
+        // rate, into output's numSamples.
+        void up(juce::AudioBuffer<float>& output)
+        {
+            auto numChannels = internal.getNumChannels();
+            auto numSamples = output.getNumSamples();
+            auto numInternal = internal.getNumSamples();
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                // From the lowest rate up, in place like down()
+                auto* work = scratch.getWritePointer(channel);
+                std::copy(internal.getReadPointer(channel), internal.getReadPointer(channel) + numInternal, work);
+
+                auto stageSamples = numInternal;
+                for (int stage = numStages - 1; stage >= 0; --stage)
+                {
+                    interpolators[static_cast<size_t>(stage * numChannels + channel)].process(work, stageSamples, work);
+                    stageSamples *= 2;
+                }
+
+                auto* waiting = queue.getWritePointer(channel);
+                std::copy(work, work + stageSamples, waiting + queued);
+
+                auto available = queued + stageSamples;
+                jassert(available >= numSamples);
+                std::copy(waiting, waiting + numSamples, output.getWritePointer(channel));
+                std::copy(waiting + numSamples, waiting + available, waiting);
+            }
+
+            queued += numInternal * factor - numSamples;
+        };
+
+    private:
+        int factor{ 1 }, numStages{ 0 }, maxInternalBlockSize{ 0 };
+        std::vector<HalfbandDecimator> decimators;
+        std::vector<HalfbandInterpolator> interpolators;
+        juce::AudioBuffer<float> internal, scratch, queue;
+        int queued{ 0 };
+    };
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// Opt-in realtime-safety checker. Configure with -DTAPDANCER_REALTIME_CHECK=ON
+// to replace the global operator new/delete with versions that report every
+// allocation or deallocation made while a ScopedRealtimeSection is alive on
+// the calling thread. On Linux it also hooks pthread_mutex_lock and the
+// blocking rwlock calls, which juce::CriticalSection, std::mutex and
+// std::shared_mutex all go through, and reports every lock taken in a
+// section the same way. Elsewhere only allocations are caught. Add
+// -DTAPDANCER_REALTIME_CHECK_ABORT=ON to abort on the first offence instead,
+// which gives a stack trace in the debugger.
+//
+// The hooks replace symbols of the executable, so they see everything the
+// tools do; in a plugin loaded by a host the host's own symbols win.
+//
+// When the check is disabled every class here compiles down to nothing.
+
+#ifndef TAPDANCER_REALTIME_CHECK
+ #define TAPDANCER_REALTIME_CHECK 0
+#endif
+
+namespace Utils
+{
+#if TAPDANCER_REALTIME_CHECK
+    // Marks the current thread as being inside the audio callback, unless
+    // isRealtime is false.
+    class ScopedRealtimeSection
+    {
+    public:
+        explicit ScopedRealtimeSection(bool isRealtime = true);
+        ~ScopedRealtimeSection();
+
+        ScopedRealtimeSection(const ScopedRealtimeSection&) = delete;
+        ScopedRealtimeSection& operator=(const ScopedRealtimeSection&) = delete;
+
+    private:
+        bool active;
+    };
+
+    // Number of allocations, deallocations and locks caught on the audio
+    // thread so far.
+    int getRealtimeViolationCount();
+#else
+    class ScopedRealtimeSection
+    {
+    public:
+        explicit ScopedRealtimeSection(bool = true) {};
+    };
+
+    inline int getRealtimeViolationCount() { return 0; }
+#endif
+}
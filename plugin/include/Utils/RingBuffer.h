@@ -0,0 +1,293 @@
+#pragma once
+
+#include "Utils/Quality.h"
+#include "Utils/StereoFrame.h"
+
+#include <juce_dsp/juce_dsp.h>
+
+#include <algorithm>
+#include <array>
+
+namespace Utils
+{
+    // Blackman windowed sinc kernels for fractional delay reads, one row per
+    // fractional phase. Built once and shared by every ring buffer.
+    class SincTable
+    {
+    public:
+        static constexpr int numTaps = 8;
+        static constexpr int numPhases = 256;
+
+        static const SincTable& getInstance()
+        {
+            static const SincTable table;
+            return table;
+        };
+
+        // Kernel for a fraction in [0, 1], rounded to the nearest phase.
+        // Tap k weights the sample k - 3 positions away from the integer delay.
+        const float* getKernel(float fraction) const
+        {
+            auto phase = static_cast<int>(fraction * static_cast<float>(numPhases) + .5f);
+            return kernels.data() + phase * numTaps;
+        };
+
+    private:
+        SincTable()
+        {
+            constexpr auto pi = juce::MathConstants<double>::pi;
+            constexpr auto halfWidth = numTaps / 2;
+
+            for (int phase = 0; phase <= numPhases; ++phase)
+            {
+                auto fraction = static_cast<double>(phase) / numPhases;
+                auto* kernel = kernels.data() + phase * numTaps;
+                double sum = 0.0;
+
+                for (int k = 0; k < numTaps; ++k)
+                {
+                    auto x = fraction - static_cast<double>(k - (halfWidth - 1));
+                    auto sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+                    auto u = x / halfWidth;
+                    auto window = .42 + .5 * std::cos(pi * u) + .08 * std::cos(2.0 * pi * u);
+                    kernel[k] = static_cast<float>(sinc * window);
+                    sum += kernel[k];
+                }
+
+                // Unity gain at DC for every phase, so modulation does not add ripple
+                for (int k = 0; k < numTaps; ++k)
+                    kernel[k] = static_cast<float>(kernel[k] / sum);
+            }
+        };
+
+        std::array<float, (numPhases + 1) * numTaps> kernels;
+    };
+
+    // Smallest delay each kernel can read without touching the slot that is
+    // about to be written.
+    template <Interpolation Kernel>
+    constexpr float getMinimumDelay()
+    {
+        if constexpr (Kernel == Interpolation::linear)
+            return 1.f;
+        else if constexpr (Kernel == Interpolation::lagrange3)
+            return 2.f;
+        else
+            return static_cast<float>(SincTable::numTaps / 2);
+    }
+
+    // Applies a read kernel around an already clamped delay. at(d) returns
+    // the sample, or frame, d steps back from the read position.
+    template <Interpolation Kernel, typename SampleAt>
+    auto interpolate(SampleAt at, float delay)
+    {
+        auto delayInt = static_cast<int>(delay);
+        auto t = delay - static_cast<float>(delayInt);
+
+        if constexpr (Kernel == Interpolation::linear)
+        {
+            auto newer = at(delayInt);
+            auto older = at(delayInt + 1);
+            return newer + t * (older - newer);
+        }
+        else if constexpr (Kernel == Interpolation::lagrange3)
+        {
+            // Nodes at -1, 0, 1 and 2 around the integer delay
+            auto tp1 = t + 1.f, tm1 = t - 1.f, tm2 = t - 2.f;
+            return at(delayInt - 1) * (-t * tm1 * tm2 * (1.f / 6.f))
+                 + at(delayInt)     * (tp1 * tm1 * tm2 * .5f)
+                 + at(delayInt + 1) * (-tp1 * t * tm2 * .5f)
+                 + at(delayInt + 2) * (tp1 * t * tm1 * (1.f / 6.f));
+        }
+        else
+        {
+            auto* kernel = SincTable::getInstance().getKernel(t);
+            auto first = delayInt - (SincTable::numTaps / 2 - 1);
+            auto output = at(first) * kernel[0];
+            for (int k = 1; k < SincTable::numTaps; ++k)
+                output = output + at(first + k) * kernel[k];
+
+            return output;
+        }
+    }
+
+    // Power-of-two delay line for a channel pair, the channels interleaved
+    // so a frame is one 8 byte load and both channels share the kernel
+    // weights. Delays are measured from the next write position, so popping
+    // before pushing a frame with a delay of d returns the frame pushed d
+    // steps ago, the same convention as juce::dsp::DelayLine. A line whose
+    // input does not depend on its output can also take a whole block with
+    // pushBlock() and be read afterwards, so the write and the reads are
+    // separate passes. The samples live in a Utils::DelayArena: prepare()
+    // only sizes the line, and it is usable once the arena has handed it
+    // memory.
+    class StereoRingBuffer
+    {
+    public:
+        StereoRingBuffer()
+        {};
+
+        ~StereoRingBuffer()
+        {};
+
+        // maxBlockSize is the most pushBlock() writes at once; one for a
+        // line that is only written frame by frame.
+        void prepare(int maxDelayInSamples, int _maxBlockSize = 1)
+        {
+            // Room for the widest kernel on top of the longest delay, plus
+            // the rest of a block written ahead of its reads
+            auto size = juce::nextPowerOfTwo(maxDelayInSamples + SincTable::numTaps + _maxBlockSize);
+            buffer = nullptr;
+            mask = size - 1;
+            writePos = 0;
+            maxDelay = static_cast<float>(maxDelayInSamples);
+            maxBlockSize = _maxBlockSize;
+
+            // Build the shared table here rather than on the audio thread
+            SincTable::getInstance();
+        };
+
+        // Memory for getCapacity() floats, owned by the caller.
+        void setMemory(float* memory)
+        {
+            buffer = memory;
+            reset();
+        };
+
+        void reset()
+        {
+            if (buffer != nullptr)
+                std::fill(buffer, buffer + getCapacity(), 0.f);
+
+            writePos = 0;
+        };
+
+        void pushFrame(StereoFrame frame)
+        {
+            frame.store(buffer + 2 * writePos);
+            writePos = (writePos + 1) & mask;
+        };
+
+        template <bool Stereo>
+        void pushBlock(const ChannelPair& channels, int numSamples)
+        {
+            jassert(numSamples <= maxBlockSize);
+            for (int s = 0; s < numSamples; ++s)
+                pushFrame(channels.read<Stereo>(s));
+        };
+
+        // After a pushBlock() of numSamples frames, what popFrame() would
+        // have returned for frame s of that block just before pushing it.
+        template <Interpolation Kernel>
+        StereoFrame popBlockFrame(float delayInSamples, int s, int numSamples) const
+        {
+            auto delay = juce::jlimit(getMinimumDelay<Kernel>(), maxDelay, delayInSamples);
+            auto readPos = writePos - numSamples + s;
+            return interpolate<Kernel>([this, readPos] (int d) { return StereoFrame::load(buffer + 2 * ((readPos - d) & mask)); }, delay);
+        };
+
+        // Both channels at the same delay. The kernel is a template argument
+        // so a block loop picks it once, see Utils::withQuality.
+        template <Interpolation Kernel>
+        StereoFrame popFrame(float delayInSamples) const
+        {
+            auto delay = juce::jlimit(getMinimumDelay<Kernel>(), maxDelay, delayInSamples);
+            return interpolate<Kernel>([this] (int d) { return StereoFrame::load(buffer + 2 * ((writePos - d) & mask)); }, delay);
+        };
+
+        // Each channel at its own delay. The kernels differ, so this runs
+        // one channel at a time.
+        template <Interpolation Kernel>
+        StereoFrame popFrame(float leftDelay, float rightDelay) const
+        {
+            constexpr auto minDelay = getMinimumDelay<Kernel>();
+            auto left = interpolate<Kernel>([this] (int d) { return buffer[2 * ((writePos - d) & mask)]; },
+                                            juce::jlimit(minDelay, maxDelay, leftDelay));
+            auto right = interpolate<Kernel>([this] (int d) { return buffer[2 * ((writePos - d) & mask) + 1]; },
+                                             juce::jlimit(minDelay, maxDelay, rightDelay));
+            return StereoFrame::make(left, right);
+        };
+
+        // In floats, two per frame.
+        int getCapacity() const { return 2 * (mask + 1); };
+
+    private:
+        float* buffer{ nullptr };
+        int mask{ 0 }, writePos{ 0 }, maxBlockSize{ 1 };
+        float maxDelay{ 0.f };
+    };
+
+    // The delay lines of a feedback delay network: numLines lines of their
+    // own lengths sharing one write position, interleaved so the next sample
+    // of every line is one aligned frame. Writing the network's new state is
+    // a single contiguous store; only the reads, each at its line's delay,
+    // are gathers.
+    class NetworkRingBuffer
+    {
+    public:
+        static constexpr int numLines = 8;
+
+        NetworkRingBuffer()
+        {};
+
+        ~NetworkRingBuffer()
+        {};
+
+        void prepare(int maxDelayInSamples)
+        {
+            auto size = juce::nextPowerOfTwo(maxDelayInSamples + 2);
+            buffer = nullptr;
+            mask = size - 1;
+            writePos = 0;
+            maxDelay = static_cast<float>(maxDelayInSamples);
+        };
+
+        void setMemory(float* memory)
+        {
+            buffer = memory;
+            reset();
+        };
+
+        void reset()
+        {
+            if (buffer != nullptr)
+                std::fill(buffer, buffer + getCapacity(), 0.f);
+
+            writePos = 0;
+        };
+
+        // What line wrote delayInSamples frames ago, 1 being the last frame.
+        float read(int line, int delayInSamples) const
+        {
+            return buffer[numLines * ((writePos - delayInSamples) & mask) + line];
+        };
+
+        // Same, between frames, with linear interpolation.
+        float readInterpolated(int line, float delayInSamples) const
+        {
+            auto delay = juce::jlimit(1.f, maxDelay, delayInSamples);
+            auto whole = static_cast<int>(delay);
+            auto fraction = delay - static_cast<float>(whole);
+
+            auto a = read(line, whole);
+            return a + fraction * (read(line, whole + 1) - a);
+        };
+
+        // Where the next frame goes, numLines floats. The arena hands out
+        // cache line aligned memory, so every frame is register aligned.
+        float* getWriteFrame() { return buffer + numLines * writePos; };
+
+        void advance()
+        {
+            writePos = (writePos + 1) & mask;
+        };
+
+        // In floats, numLines per frame.
+        int getCapacity() const { return numLines * (mask + 1); };
+
+    private:
+        float* buffer{ nullptr };
+        int mask{ 0 }, writePos{ 0 };
+        float maxDelay{ 0.f };
+    };
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace Utils
+{
+    // Decides when a stage of the chain can stop running. A stage goes to
+    // sleep once its input has been silent for longer than its tail and the
+    // last block it produced was silent too, and wakes on the first input
+    // block with anything in it. Silence is a peak below threshold, -100 dB.
+    class SilenceGate
+    {
+    public:
+        static constexpr float threshold = 1.0e-5f;
+
+        SilenceGate()
+        {};
+
+        ~SilenceGate()
+        {};
+
+        void reset()
+        {
+            silentSamples = 0.0;
+            asleep = false;
+        };
+
+        void setTailLength(float samples)
+        {
+            tailLength = static_cast<double>(samples);
+        };
+
+        // Call with the stage's input before running it. Returns false when
+        // the stage is asleep and should be skipped.
+        bool shouldProcess(const juce::AudioBuffer<float>& input)
+        {
+            if (! isSilent(input))
+            {
+                silentSamples = 0.0;
+                asleep = false;
+                return true;
+            }
+
+            if (asleep)
+                return false;
+
+            silentSamples += input.getNumSamples();
+            return true;
+        };
+
+        // Call with the stage's output after running it. Returns true when
+        // the stage has just gone to sleep, so the caller can clear its state
+        // and the next wake starts from silence.
+        bool checkOutput(const juce::AudioBuffer<float>& output)
+        {
+            if (silentSamples <= tailLength || ! isSilent(output))
+                return false;
+
+            asleep = true;
+            return true;
+        };
+
+        bool isAsleep() const { return asleep; };
+
+        static bool isSilent(const juce::AudioBuffer<float>& buffer)
+        {
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            {
+                if (buffer.getMagnitude(channel, 0, buffer.getNumSamples()) >= threshold)
+                    return false;
+            }
+
+            return true;
+        };
+
+    private:
+        double silentSamples{ 0.0 }, tailLength{ 0.0 };
+        bool asleep{ false };
+    };
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "Utils/StageProfiler.h"
+
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <limits>
+
+#if JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+namespace Utils
+{
+    // The cheapest monotonic counter the CPU has: the time stamp counter on
+    // x86, the virtual counter on 64 bit ARM and the high resolution timer
+    // anywhere else. Only differences between two reads mean anything.
+    inline juce::uint64 readCycleCounter() noexcept
+    {
+       #if JUCE_INTEL
+        return static_cast<juce::uint64>(__rdtsc());
+       #elif JUCE_ARM && defined (__aarch64__) && ! JUCE_MSVC
+        juce::uint64 value;
+        asm volatile ("mrs %0, cntvct_el0" : "=r" (value));
+        return value;
+       #else
+        return static_cast<juce::uint64>(juce::Time::getHighResolutionTicks());
+       #endif
+    }
+
+    // Always-on per-stage load meter for the editor. The audio thread stamps
+    // every stage of processBlock with readCycleCounter(), folds a short
+    // window of blocks into min, average and max shares of the block deadline,
+    // and pushes one Report per window into a single producer, single
+    // consumer FIFO. The audio side never locks, allocates or waits; when the
+    // reader falls behind, reports are dropped.
+    class StageMeter
+    {
+    public:
+        static constexpr int numStages = static_cast<int>(Stage::numStages);
+        static constexpr int fifoSize = 32;
+
+        // Shares of the block deadline, 1 being all of it.
+        struct Load
+        {
+            float min{ 0.f }, average{ 0.f }, max{ 0.f };
+        };
+
+        struct Report
+        {
+            std::array<Load, numStages> stages;
+            Load total;
+        };
+
+        StageMeter()
+        {};
+
+        ~StageMeter()
+        {};
+
+        // windowSeconds of audio go into each report.
+        void prepare(double _sampleRate, double windowSeconds = .1)
+        {
+            sampleRate = _sampleRate;
+            reportSamples = juce::jmax(1, static_cast<int>(sampleRate * windowSeconds));
+            startWindow();
+        };
+
+        //== Audio thread ======================================================
+        void beginBlock(int numSamples)
+        {
+            blockSamples = numSamples;
+            blockCycles.fill(0);
+            blockStartTicks = juce::Time::getHighResolutionTicks();
+            blockStartCycles = lastCycles = readCycleCounter();
+        };
+
+        void lap(Stage stage)
+        {
+            auto now = readCycleCounter();
+            blockCycles[static_cast<size_t>(stage)] += now - lastCycles;
+            lastCycles = now;
+        };
+
+        void endBlock()
+        {
+            auto endCycles = readCycleCounter();
+            auto endTicks = juce::Time::getHighResolutionTicks();
+
+            if (blockSamples <= 0)
+                return;
+
+            // Per sample, so blocks of different sizes compare
+            auto samples = static_cast<double>(blockSamples);
+            for (size_t i = 0; i < blockCycles.size(); ++i)
+                window.stages[i].add(static_cast<double>(blockCycles[i]) / samples, static_cast<double>(blockCycles[i]));
+
+            auto totalCycles = static_cast<double>(endCycles - blockStartCycles);
+            window.total.add(totalCycles / samples, totalCycles);
+            window.cycles += totalCycles;
+            window.ticks += endTicks - blockStartTicks;
+            window.samples += blockSamples;
+
+            if (window.samples >= reportSamples)
+            {
+                publish();
+                startWindow();
+            }
+        };
+
+        //== Reader ============================================================
+        // Takes the oldest report not read yet, if there is one.
+        bool pop(Report& report)
+        {
+            auto scope = fifo.read(1);
+            if (scope.blockSize1 == 0)
+                return false;
+
+            report = reports[static_cast<size_t>(scope.startIndex1)];
+            return true;
+        };
+
+    private:
+        struct Accumulator
+        {
+            double min{ std::numeric_limits<double>::max() }, max{ 0.0 }, sum{ 0.0 };
+
+            void add(double cyclesPerSample, double cycles)
+            {
+                min = juce::jmin(min, cyclesPerSample);
+                max = juce::jmax(max, cyclesPerSample);
+                sum += cycles;
+            };
+
+            Load toLoad(double budgetPerSample, int numSamples) const
+            {
+                return { static_cast<float>(min / budgetPerSample),
+                         static_cast<float>(sum / numSamples / budgetPerSample),
+                         static_cast<float>(max / budgetPerSample) };
+            };
+        };
+
+        struct Window
+        {
+            std::array<Accumulator, numStages> stages;
+            Accumulator total;
+            double cycles{ 0.0 };
+            juce::int64 ticks{ 0 };
+            int samples{ 0 };
+        };
+
+        void startWindow()
+        {
+            window = {};
+        };
+
+        void publish()
+        {
+            // The counter's rate comes from the same window it measured, so
+            // no calibration is needed and frequency scaling is followed
+            auto seconds = juce::Time::highResolutionTicksToSeconds(window.ticks);
+            if (seconds <= 0.0 || window.cycles <= 0.0)
+                return;
+
+            auto budgetPerSample = window.cycles / seconds / sampleRate;
+
+            Report report;
+            for (size_t i = 0; i < window.stages.size(); ++i)
+                report.stages[i] = window.stages[i].toLoad(budgetPerSample, window.samples);
+            report.total = window.total.toLoad(budgetPerSample, window.samples);
+
+            auto scope = fifo.write(1);
+            if (scope.blockSize1 > 0)
+                reports[static_cast<size_t>(scope.startIndex1)] = report;
+        };
+
+        double sampleRate{ 44100.0 };
+        int reportSamples{ 4410 }, blockSamples{ 0 };
+        juce::int64 blockStartTicks{ 0 };
+        juce::uint64 blockStartCycles{ 0 }, lastCycles{ 0 };
+        std::array<juce::uint64, numStages> blockCycles{};
+        Window window;
+
+        juce::AbstractFifo fifo{ fifoSize };
+        std::array<Report, fifoSize> reports;
+    };
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <array>
+
+namespace Utils
+{
+    // Stages of AudioPluginAudioProcessor::processBlock, in the order they run.
+    enum class Stage
+    {
+        preamp,
+        tapsDelay,
+        diffuser1stStage,
+        diffuser2ndStage,
+        fdnVerb,
+        output,
+        numStages
+    };
+
+    inline const char* getStageName(Stage stage)
+    {
+        switch (stage)
+        {
+            case Stage::preamp:             return "preamp";
+            case Stage::tapsDelay:          return "tapsDelay";
+            case Stage::diffuser1stStage:   return "diffuser1stStage";
+            case Stage::diffuser2ndStage:   return "diffuser2ndStage";
+            case Stage::fdnVerb:            return "fdnVerb";
+            case Stage::output:             return "output";
+            case Stage::numStages:          break;
+        }
+
+        return "unknown";
+    }
+
+    // Accumulates the wall clock time spent on each stage of the chain.
+    // The processor calls beginBlock() at the top of processBlock and lap()
+    // after every stage, so each lap is charged to the stage that just ended.
+    class StageProfiler
+    {
+    public:
+        static constexpr int numStages = static_cast<int>(Stage::numStages);
+
+        StageProfiler()
+        {};
+
+        ~StageProfiler()
+        {};
+
+        void beginBlock(int numSamples)
+        {
+            lastTick = juce::Time::getHighResolutionTicks();
+            processedSamples += numSamples;
+            ++processedBlocks;
+        };
+
+        void lap(Stage stage)
+        {
+            auto now = juce::Time::getHighResolutionTicks();
+            stageTicks[static_cast<size_t>(stage)] += now - lastTick;
+            lastTick = now;
+        };
+
+        void reset()
+        {
+            stageTicks.fill(0);
+            processedSamples = 0;
+            processedBlocks = 0;
+        };
+
+        double getStageSeconds(Stage stage) const
+        {
+            return juce::Time::highResolutionTicksToSeconds(stageTicks[static_cast<size_t>(stage)]);
+        };
+
+        double getTotalSeconds() const
+        {
+            juce::int64 total = 0;
+            for (auto t : stageTicks)
+                total += t;
+
+            return juce::Time::highResolutionTicksToSeconds(total);
+        };
+
+        juce::int64 getNumSamples() const { return processedSamples; };
+        juce::int64 getNumBlocks() const { return processedBlocks; };
+
+    private:
+        std::array<juce::int64, numStages> stageTicks{};
+        juce::int64 lastTick{ 0 }, processedSamples{ 0 }, processedBlocks{ 0 };
+    };
+}
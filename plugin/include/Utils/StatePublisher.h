@@ -0,0 +1,180 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+namespace Utils
+{
+    // Hands objects built on another thread to the audio thread. There are
+    // two slots: incoming holds the newest object nobody has taken yet, and
+    // outgoing holds the one the audio thread let go of. The audio thread
+    // only swaps pointers, so it never allocates, frees or waits; whatever
+    // it retires is freed by the builder the next time round.
+    template <typename State>
+    class StatePublisher
+    {
+    public:
+        StatePublisher()
+        {};
+
+        ~StatePublisher()
+        {
+            delete incoming.exchange(nullptr);
+            delete outgoing.exchange(nullptr);
+        };
+
+        //== Builder side, one thread at a time ================================
+        // Offers next to the audio thread. A previous object it never took is
+        // dropped here, so only the newest one is ever picked up.
+        void publish(std::unique_ptr<State> next)
+        {
+            collectRetired();
+            delete incoming.exchange(next.release(), std::memory_order_acq_rel);
+        };
+
+        // Frees what the audio thread let go of.
+        void collectRetired()
+        {
+            delete outgoing.exchange(nullptr, std::memory_order_acq_rel);
+        };
+
+        // Only while the audio thread is not running: makes state current
+        // straight away and drops anything in flight.
+        void reset(std::unique_ptr<State> state)
+        {
+            delete incoming.exchange(nullptr);
+            delete outgoing.exchange(nullptr);
+            current = std::move(state);
+        };
+
+        //== Audio thread ======================================================
+        // Takes over the newest object, if there is one and the last one it
+        // replaced has been freed. Returns true when the object changed.
+        bool update()
+        {
+            auto* next = incoming.load(std::memory_order_acquire);
+            if (next == nullptr || outgoing.load(std::memory_order_acquire) != nullptr)
+                return false;
+
+            // The builder may have replaced next with a newer one meanwhile
+            if (! incoming.compare_exchange_strong(next, nullptr, std::memory_order_acq_rel))
+                return false;
+
+            outgoing.store(current.release(), std::memory_order_release);
+            current.reset(next);
+            return true;
+        };
+
+        State* get() const { return current.get(); };
+
+    private:
+        std::unique_ptr<State> current;
+        std::atomic<State*> incoming{ nullptr }, outgoing{ nullptr };
+    };
+
+    // Builds State from Request on a worker thread shared by every instance
+    // and publishes it through a StatePublisher. request() is wait-free, so
+    // the audio thread can post one when a parameter moves; requests that
+    // pile up before the worker gets to them collapse into the newest. The
+    // worker polls, so a build starts within pollIntervalMs of its request.
+    template <typename Request, typename State>
+    class StateBuilder : private juce::TimeSliceClient
+    {
+    public:
+        static_assert(std::is_trivially_copyable_v<Request>, "Requests are copied on the audio thread");
+
+        // Returns the new state, or nullptr to keep the current one.
+        using Build = std::function<std::unique_ptr<State>(const Request&)>;
+
+        static constexpr int pollIntervalMs = 10;
+
+        explicit StateBuilder(Build _build) : build(std::move(_build))
+        {
+            worker->addTimeSliceClient(this);
+        };
+
+        // Waits for a build that is running, so destroy this before anything
+        // the build function uses.
+        ~StateBuilder() override
+        {
+            worker->removeTimeSliceClient(this);
+        };
+
+        // One producer thread, which may be the audio thread.
+        void request(const Request& r)
+        {
+            slots[static_cast<size_t>(back)] = r;
+            back = middle.exchange(back | fresh, std::memory_order_acq_rel) & indexMask;
+        };
+
+        // Not for the audio thread, and only while it is not running: builds
+        // for r here and makes the result current, dropping any pending
+        // request.
+        void rebuildNow(const Request& r)
+        {
+            const juce::ScopedLock lock(buildLock);
+
+            Request discarded;
+            takeRequest(discarded);
+            publisher.reset(build(r));
+        };
+
+        //== Audio thread ======================================================
+        bool update() { return publisher.update(); };
+        State* get() const { return publisher.get(); };
+
+    private:
+        struct Worker : juce::TimeSliceThread
+        {
+            Worker() : juce::TimeSliceThread("TapDancer builder")
+            {
+                startThread(juce::Thread::Priority::low);
+            };
+
+            ~Worker() override
+            {
+                stopThread(-1);
+            };
+        };
+
+        int useTimeSlice() override
+        {
+            const juce::ScopedLock lock(buildLock);
+            publisher.collectRetired();
+
+            Request r;
+            if (takeRequest(r))
+                if (auto next = build(r))
+                    publisher.publish(std::move(next));
+
+            return pollIntervalMs;
+        };
+
+        // The other end of request(): a triple buffer, so neither side ever
+        // waits for the other and the consumer always sees the newest value.
+        bool takeRequest(Request& r)
+        {
+            if ((middle.load(std::memory_order_acquire) & fresh) == 0)
+                return false;
+
+            front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+            r = slots[static_cast<size_t>(front)];
+            return true;
+        };
+
+        juce::SharedResourcePointer<Worker> worker;
+        Build build;
+        juce::CriticalSection buildLock;
+        StatePublisher<State> publisher;
+
+        static constexpr int indexMask = 3, fresh = 4;
+        std::array<Request, 3> slots{};
+        std::atomic<int> middle{ 1 };
+        int back{ 0 }, front{ 2 };
+    };
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "Utils/FastMath.h"
+
+#include <juce_dsp/juce_dsp.h>
+
+#include <cmath>
+
+namespace Utils
+{
+    // The left and right sample of one frame in a single register, so a
+    // recursive filter or feedback loop can run both channels at once. The
+    // loops cannot be vectorised over time, pairing the channels is the only
+    // parallelism they have. On SSE the pair sits in the low half of an
+    // __m128, on NEON in a float32x2_t.
+    struct StereoFrame
+    {
+       #if JUCE_USE_SSE_INTRINSICS
+        using NativeType = __m128;
+       #elif JUCE_USE_ARM_NEON
+        using NativeType = float32x2_t;
+       #else
+        struct NativeType { float l, r; };
+       #endif
+
+        NativeType value;
+
+        //======================================================================
+        static StereoFrame fromNative(NativeType native) noexcept
+        {
+            StereoFrame frame;
+            frame.value = native;
+            return frame;
+        }
+
+        static StereoFrame make(float left, float right) noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            return fromNative(_mm_setr_ps(left, right, 0.f, 0.f));
+           #elif JUCE_USE_ARM_NEON
+            return fromNative(vset_lane_f32(right, vdup_n_f32(left), 1));
+           #else
+            return fromNative({ left, right });
+           #endif
+        }
+
+        static StereoFrame expand(float s) noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            return fromNative(_mm_set1_ps(s));
+           #elif JUCE_USE_ARM_NEON
+            return fromNative(vdup_n_f32(s));
+           #else
+            return fromNative({ s, s });
+           #endif
+        }
+
+        // Reads and writes two interleaved floats, left first.
+        static StereoFrame load(const float* source) noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            return fromNative(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(source))));
+           #elif JUCE_USE_ARM_NEON
+            return fromNative(vld1_f32(source));
+           #else
+            return fromNative({ source[0], source[1] });
+           #endif
+        }
+
+        void store(float* destination) const noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            _mm_store_sd(reinterpret_cast<double*>(destination), _mm_castps_pd(value));
+           #elif JUCE_USE_ARM_NEON
+            vst1_f32(destination, value);
+           #else
+            destination[0] = value.l;
+            destination[1] = value.r;
+           #endif
+        }
+
+        float left() const noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            return _mm_cvtss_f32(value);
+           #elif JUCE_USE_ARM_NEON
+            return vget_lane_f32(value, 0);
+           #else
+            return value.l;
+           #endif
+        }
+
+        float right() const noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            return _mm_cvtss_f32(_mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 1, 1, 1)));
+           #elif JUCE_USE_ARM_NEON
+            return vget_lane_f32(value, 1);
+           #else
+            return value.r;
+           #endif
+        }
+
+        //======================================================================
+        friend StereoFrame operator+(StereoFrame a, StereoFrame b) noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            return fromNative(_mm_add_ps(a.value, b.value));
+           #elif JUCE_USE_ARM_NEON
+            return fromNative(vadd_f32(a.value, b.value));
+           #else
+            return fromNative({ a.value.l + b.value.l, a.value.r + b.value.r });
+           #endif
+        }
+
+        friend StereoFrame operator-(StereoFrame a, StereoFrame b) noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            return fromNative(_mm_sub_ps(a.value, b.value));
+           #elif JUCE_USE_ARM_NEON
+            return fromNative(vsub_f32(a.value, b.value));
+           #else
+            return fromNative({ a.value.l - b.value.l, a.value.r - b.value.r });
+           #endif
+        }
+
+        friend StereoFrame operator*(StereoFrame a, StereoFrame b) noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            return fromNative(_mm_mul_ps(a.value, b.value));
+           #elif JUCE_USE_ARM_NEON
+            return fromNative(vmul_f32(a.value, b.value));
+           #else
+            return fromNative({ a.value.l * b.value.l, a.value.r * b.value.r });
+           #endif
+        }
+
+        friend StereoFrame operator+(StereoFrame a, float b) noexcept { return a + expand(b); }
+        friend StereoFrame operator-(StereoFrame a, float b) noexcept { return a - expand(b); }
+        friend StereoFrame operator*(StereoFrame a, float b) noexcept { return a * expand(b); }
+        friend StereoFrame operator*(float a, StereoFrame b) noexcept { return expand(a) * b; }
+        friend StereoFrame operator-(StereoFrame a) noexcept { return expand(0.f) - a; }
+
+        static StereoFrame min(StereoFrame a, StereoFrame b) noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            return fromNative(_mm_min_ps(a.value, b.value));
+           #elif JUCE_USE_ARM_NEON
+            return fromNative(vmin_f32(a.value, b.value));
+           #else
+            return fromNative({ std::min(a.value.l, b.value.l), std::min(a.value.r, b.value.r) });
+           #endif
+        }
+
+        static StereoFrame max(StereoFrame a, StereoFrame b) noexcept
+        {
+           #if JUCE_USE_SSE_INTRINSICS
+            return fromNative(_mm_max_ps(a.value, b.value));
+           #elif JUCE_USE_ARM_NEON
+            return fromNative(vmax_f32(a.value, b.value));
+           #else
+            return fromNative({ std::max(a.value.l, b.value.l), std::max(a.value.r, b.value.r) });
+           #endif
+        }
+    };
+
+    //==========================================================================
+    // Overloads that let the FastMath templates run on a StereoFrame.
+    inline StereoFrame clampValue(StereoFrame x, float lower, float upper)
+    {
+        return StereoFrame::max(StereoFrame::expand(lower), StereoFrame::min(x, StereoFrame::expand(upper)));
+    }
+
+    inline StereoFrame divide(StereoFrame numerator, StereoFrame denominator)
+    {
+       #if JUCE_USE_SSE_INTRINSICS
+        return StereoFrame::fromNative(_mm_div_ps(numerator.value, denominator.value));
+       #elif JUCE_USE_ARM_NEON && defined (__aarch64__)
+        return StereoFrame::fromNative(vdiv_f32(numerator.value, denominator.value));
+       #else
+        return StereoFrame::make(numerator.left() / denominator.left(), numerator.right() / denominator.right());
+       #endif
+    }
+
+    // std::tanh, one lane at a time.
+    inline StereoFrame exactTanh(StereoFrame x)
+    {
+        return StereoFrame::make(std::tanh(x.left()), std::tanh(x.right()));
+    }
+
+    //==========================================================================
+    // Two channels of a planar buffer, walked as frames. A layout with an odd
+    // channel count pairs its last channel with silence and drops the
+    // partner's output. Stereo says whether right exists, fixed at compile
+    // time so the per-sample loops do not test it, see Utils::withPairLayout.
+    struct ChannelPair
+    {
+        float* left;
+        float* right;
+
+        template <bool Stereo>
+        StereoFrame read(int sample) const
+        {
+            if constexpr (Stereo)
+                return StereoFrame::make(left[sample], right[sample]);
+            else
+                return StereoFrame::make(left[sample], 0.f);
+        }
+
+        template <bool Stereo>
+        void write(int sample, StereoFrame frame) const
+        {
+            left[sample] = frame.left();
+            if constexpr (Stereo)
+                right[sample] = frame.right();
+        }
+    };
+
+    inline int getNumChannelPairs(int numChannels)
+    {
+        return (numChannels + 1) / 2;
+    }
+
+    inline ChannelPair getChannelPair(juce::AudioBuffer<float>& buffer, int pair)
+    {
+        auto leftChannel = 2 * pair;
+        auto rightChannel = leftChannel + 1;
+        return { buffer.getWritePointer(leftChannel),
+                 rightChannel < buffer.getNumChannels() ? buffer.getWritePointer(rightChannel) : nullptr };
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace Utils
+{
+    // Runs the chain on complete sub-blocks of a fixed size, whatever block
+    // sizes the host sends. Host samples are collected in a FIFO until a
+    // whole sub-block is in, which is then processed in one go, and the host
+    // gets back the sub-block processed before it. That costs size samples
+    // of latency, which the processor reports. The chain always sees the same
+    // boundaries and full blocks, in buffers of the scheduler's own.
+    class SubBlockScheduler
+    {
+    public:
+        SubBlockScheduler()
+        {};
+
+        ~SubBlockScheduler()
+        {};
+
+        // Not for the audio thread.
+        void prepare(int numChannels, int _size)
+        {
+            size = _size;
+            input.setSize(numChannels, size);
+            output.setSize(numChannels, size);
+            reset();
+        };
+
+        void reset()
+        {
+            input.clear();
+            output.clear();
+            position = 0;
+        };
+
+        int getSize() const { return size; };
+        int getLatency() const { return size; };
+
+        // Swaps buffer's samples through the FIFO, calling processSubBlock
+        // each time a sub-block is complete. Never allocates.
+        template <typename Process>
+        void process(juce::AudioBuffer<float>& buffer, Process&& processSubBlock)
+        {
+            auto numSamples = buffer.getNumSamples();
+            auto numChannels = juce::jmin(buffer.getNumChannels(), input.getNumChannels());
+
+            for (int start = 0; start < numSamples;)
+            {
+                auto length = juce::jmin(numSamples - start, size - position);
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    input.copyFrom(channel, position, buffer, channel, start, length);
+                    buffer.copyFrom(channel, start, output, channel, position, length);
+                }
+
+                start += length;
+                position += length;
+
+                if (position == size)
+                {
+                    processSubBlock(input);
+                    std::swap(input, output);
+                    position = 0;
+                }
+            }
+        };
+
+    private:
+        juce::AudioBuffer<float> input, output;
+        int size{ 64 }, position{ 0 };
+    };
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace Utils
+{
+    // Fans independent tasks out over a few worker threads, for offline
+    // renders. Tasks are claimed one at a time from a shared counter, so
+    // whichever thread runs out of work first takes the next one, and the
+    // calling thread works as well. Every task must touch only its own
+    // state; it then runs exactly the code the serial path runs, and the
+    // output does not depend on which thread picked it up. With no workers
+    // started, run() is a plain loop on the calling thread.
+    class TaskPool
+    {
+    public:
+        TaskPool()
+        {};
+
+        ~TaskPool()
+        {
+            stop();
+        };
+
+        // Not for the audio thread: starts or joins threads.
+        void start(int numWorkers)
+        {
+            if (numWorkers == getNumWorkers())
+                return;
+
+            stop();
+            for (int i = 0; i < numWorkers; ++i)
+            {
+                workers.push_back(std::make_unique<Worker>(*this));
+                workers.back()->startThread(juce::Thread::Priority::high);
+            }
+        };
+
+        void stop()
+        {
+            for (auto& w : workers)
+            {
+                w->signalThreadShouldExit();
+                w->wake.signal();
+            }
+
+            for (auto& w : workers)
+                w->stopThread(-1);
+
+            workers.clear();
+        };
+
+        int getNumWorkers() const { return static_cast<int>(workers.size()); };
+
+        // Calls task(i) for every i in [0, numTasks) and returns once they
+        // have all finished.
+        template <typename Task>
+        void run(int numTasks, Task&& task)
+        {
+            if (workers.empty() || numTasks < 2)
+            {
+                for (int i = 0; i < numTasks; ++i)
+                    task(i);
+
+                return;
+            }
+
+            // Published by the release store of claims, and only read by a
+            // thread that has claimed one of this run's tasks
+            context = &task;
+            invoke = [] (void* c, int i) { (*static_cast<std::remove_reference_t<Task>*>(c))(i); };
+            remaining.store(numTasks, std::memory_order_relaxed);
+            claims.store(static_cast<uint64_t>(numTasks) << 32, std::memory_order_release);
+
+            for (auto& w : workers)
+                w->wake.signal();
+
+            work();
+            finished.wait(-1);
+        };
+
+    private:
+        class Worker : public juce::Thread
+        {
+        public:
+            Worker(TaskPool& _pool) : juce::Thread("TapDancer worker"), pool(_pool)
+            {};
+
+            void run() override
+            {
+                while (! threadShouldExit())
+                {
+                    wake.wait(-1);
+                    if (! threadShouldExit())
+                        pool.work();
+                }
+            };
+
+            juce::WaitableEvent wake;
+
+        private:
+            TaskPool& pool;
+        };
+
+        // A claim returns the run's task count along with the index, from the
+        // same word, so it is always checked against the run it was taken
+        // from. A worker that wakes late either finds a finished run's index
+        // past its count and claims nothing, or takes a real task of the
+        // run that stored the word; it never pairs one run's index with
+        // another's count or task.
+        void work()
+        {
+            for (;;)
+            {
+                auto claim = claims.fetch_add(1, std::memory_order_acquire);
+                auto index = static_cast<int>(claim & 0xffffffff);
+                if (index >= static_cast<int>(claim >> 32))
+                    return;
+
+                invoke(context, index);
+
+                if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    finished.signal();
+            }
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        juce::WaitableEvent finished;
+
+        void* context{ nullptr };
+        void (*invoke)(void*, int){ nullptr };
+
+        // The run's task count in the high half and the next index in the
+        // low half, see work()
+        std::atomic<uint64_t> claims{ 0 };
+        std::atomic<int> remaining{ 0 };
+    };
+}
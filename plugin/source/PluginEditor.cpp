@@ -1,15 +1,118 @@
 #include "TapDancer/PluginProcessor.h"
 #include "TapDancer/PluginEditor.h"
 
+//==============================================================================
+StageMeterView::StageMeterView (AudioPluginAudioProcessor& p)
+    : processorRef (p)
+{
+    startTimerHz (10);
+}
+
+StageMeterView::~StageMeterView()
+{
+}
+
+void StageMeterView::timerCallback()
+{
+    // Drain everything the audio thread published, keep the newest
+    auto fresh = false;
+    while (processorRef.getStageMeter().pop (report))
+        fresh = true;
+
+    if (fresh)
+    {
+        hasReport = true;
+        repaint();
+    }
+}
+
+void StageMeterView::paint (juce::Graphics& g)
+{
+    g.fillAll (juce::Colours::black.withAlpha (.85f));
+
+    auto area = getLocalBounds().reduced (10);
+
+    g.setColour (juce::Colours::whitesmoke);
+    g.setFont (16.0f);
+    g.drawFittedText (processorRef.getInstanceName(), area.removeFromTop (24), juce::Justification::centredLeft, 1);
+
+    g.setFont (12.0f);
+    g.setColour (juce::Colours::grey);
+    g.drawFittedText ("Share of block deadline, min / avg / max", area.removeFromTop (18), juce::Justification::centredLeft, 1);
+
+    if (! hasReport)
+    {
+        g.drawFittedText ("Waiting for audio", area, juce::Justification::centred, 1);
+        return;
+    }
+
+    auto rowHeight = juce::jmin (28, area.getHeight() / (Utils::StageMeter::numStages + 1));
+
+    for (int stage = 0; stage < Utils::StageMeter::numStages; ++stage)
+        paintRow (g, area.removeFromTop (rowHeight), Utils::getStageName (static_cast<Utils::Stage> (stage)),
+                  report.stages[static_cast<size_t> (stage)]);
+
+    paintRow (g, area.removeFromTop (rowHeight), "total", report.total);
+}
+
+void StageMeterView::paintRow (juce::Graphics& g, juce::Rectangle<int> area, const juce::String& name,
+                               const Utils::StageMeter::Load& load)
+{
+    auto toPercent = [] (float share) { return juce::String (share * 100.f, 1); };
+
+    g.setFont (12.0f);
+    g.setColour (juce::Colours::whitesmoke);
+    g.drawFittedText (name, area.removeFromLeft (100), juce::Justification::centredLeft, 1);
+    g.drawFittedText (toPercent (load.min) + " / " + toPercent (load.average) + " / " + toPercent (load.max) + " %",
+                      area.removeFromRight (110), juce::Justification::centredRight, 1);
+
+    // The whole bar is the deadline; the faint span runs from min to max
+    auto bar = area.reduced (4, 8).toFloat();
+    auto toX = [&bar] (float share) { return bar.getX() + bar.getWidth() * juce::jlimit (0.f, 1.f, share); };
+
+    g.setColour (juce::Colours::darkgrey);
+    g.fillRect (bar);
+
+    auto colour = load.max < .5f ? juce::Colours::limegreen
+                : load.max < .8f ? juce::Colours::orange
+                                 : juce::Colours::red;
+
+    g.setColour (colour.withAlpha (.35f));
+    g.fillRect (bar.withLeft (toX (load.min)).withRight (toX (load.max)));
+    g.setColour (colour);
+    g.fillRect (bar.withRight (toX (load.average)));
+}
+
 //==============================================================================
 AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor& p)
-    : AudioProcessorEditor (&p), processorRef (p)
+    : AudioProcessorEditor (&p), processorRef (p), parameterEditor (p), stageMeterView (p)
 {
-    juce::ignoreUnused (processorRef);
+    addAndMakeVisible (parameterEditor);
+    addAndMakeVisible (stageMeterView);
+    addAndMakeVisible (loadImpulseResponseButton);
+
+    addAndMakeVisible (presetBox);
+    for (int i = 0; i < processorRef.getNumPrograms(); ++i)
+        presetBox.addItem (processorRef.getProgramName (i), i + 1);
+
+    presetBox.setSelectedId (processorRef.getCurrentProgram() + 1, juce::dontSendNotification);
+    presetBox.onChange = [this]
+    {
+        processorRef.setCurrentProgram (presetBox.getSelectedId() - 1);
+        processorRef.updateHostDisplay (juce::AudioProcessor::ChangeDetails().withProgramChanged (true));
+    };
+
+    loadImpulseResponseButton.setTooltip (processorRef.getImpulseResponseFile().getFullPathName());
+    loadImpulseResponseButton.onClick = [this] { chooseImpulseResponse(); };
+
+    addAndMakeVisible (wetDownsamplingButton);
+    wetDownsamplingButton.setTooltip ("Runs the taps and the diffuser at 44.1 or 48 kHz in high sample rate sessions");
+    wetDownsamplingButton.setToggleState (processorRef.isWetDownsampling(), juce::dontSendNotification);
+    wetDownsamplingButton.onClick = [this] { processorRef.setWetDownsampling (wetDownsamplingButton.getToggleState()); };
+
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-
-    setSize (1000, 450);
+    setSize (parameterEditor.getWidth() + meterWidth, juce::jmax (parameterEditor.getHeight(), minHeight));
 }
 
 AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor()
@@ -20,16 +123,35 @@ AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor()
 void AudioPluginAudioProcessorEditor::paint (juce::Graphics& g)
 {
     // (Our component is opaque, so we must completely fill the background with a solid colour)
-    g.fillAll (juce::Colour::fromFloatRGBA(1.f, 0.f, 0.f, .25f));
-
-    g.setColour (juce::Colours::whitesmoke);
-    g.setFont (36.0f);
-    g.drawFittedText ("TapDancer", getLocalBounds(), juce::Justification::centredTop, 1);
+    g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
 }
 
 void AudioPluginAudioProcessorEditor::resized()
 {
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
+    auto area = getLocalBounds();
+    auto side = area.removeFromRight (meterWidth);
+
+    presetBox.setBounds (side.removeFromTop (buttonHeight).reduced (6, 4));
+    wetDownsamplingButton.setBounds (side.removeFromBottom (buttonHeight).reduced (6, 4));
+    loadImpulseResponseButton.setBounds (side.removeFromBottom (buttonHeight).reduced (6, 4));
+    stageMeterView.setBounds (side);
+    parameterEditor.setBounds (area);
+}
+
+void AudioPluginAudioProcessorEditor::chooseImpulseResponse()
+{
+    impulseResponseChooser = std::make_unique<juce::FileChooser> ("Choose an impulse response",
+                                                                  processorRef.getImpulseResponseFile(),
+                                                                  "*.wav;*.aif;*.aiff;*.flac");
+
+    auto flags = juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles;
+    impulseResponseChooser->launchAsync (flags, [this] (const juce::FileChooser& chooser)
+    {
+        auto file = chooser.getResult();
+        if (file == juce::File())
+            return;
 
+        processorRef.loadImpulseResponse (file);
+        loadImpulseResponseButton.setTooltip (file.getFullPathName());
+    });
 }
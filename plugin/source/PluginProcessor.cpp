@@ -14,8 +14,12 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                      #endif
                        ),
         treeState(*this, nullptr, "PARAMS", createParameterLayout()),
-        lowCutFilter(juce::dsp::IIR::Coefficients<float>::makeFirstOrderHighPass(44100, 20.f))
+        parameterCache(treeState)
 {
+    // Numbered in load order, so the meter can tell instances apart before
+    // the host has named their track
+    static std::atomic<int> numInstances{ 0 };
+    instanceNumber = ++numInstances;
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor()
@@ -46,6 +50,7 @@ juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::c
 
     // Diffuser Params
     params.push_back(std::make_unique<juce::AudioParameterFloat>("DIFFUSER_ID", "Diffuser", 0.f, 1.f, 0.f));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("DIFFUSER_TYPE_ID", "Diffuser Type", juce::StringArray{ "Allpass", "FDN", "Convolution" }, 0));
 
     // Taps and Diffuser Params
     params.push_back(std::make_unique<juce::AudioParameterFloat>("MOD_ID", "Modulation", 0.f, 1.f, 0.f));
@@ -56,6 +61,10 @@ juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::c
     params.push_back(std::make_unique<juce::AudioParameterFloat>("DRYWET_ID", "Dry Wet", .0f, 1.f, .5f));
     params.push_back(std::make_unique<juce::AudioParameterFloat>("OUTPUT_ID", "Output Gain", .0f, 2.f, 1.f));
 
+    // QUALITY SECTION PARAMS
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("QUALITY_ID", "Quality", juce::StringArray{ "Eco", "Standard", "High" }, 1));
+    params.push_back(std::make_unique<juce::AudioParameterBool>("GOVERNOR_ID", "Auto Quality", false));
+
     return { params.begin(), params.end() };
 }
 
@@ -94,34 +103,89 @@ bool AudioPluginAudioProcessor::isMidiEffect() const
 
 double AudioPluginAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    return tailLengthSeconds.load(std::memory_order_relaxed);
 }
 
 int AudioPluginAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return static_cast<int>(presetBank.size());
 }
 
 int AudioPluginAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram;
 }
 
 void AudioPluginAudioProcessor::setCurrentProgram (int index)
 {
-    juce::ignoreUnused (index);
+    if (! juce::isPositiveAndBelow(index, getNumPrograms()))
+        return;
+
+    currentProgram = index;
+
+    // Parameters the preset does not name go back to their defaults, and
+    // the ones it does not own stay as they are
+    auto values = getStateValues();
+    for (size_t i = 0; i < TapDancer::stateParameters.size(); ++i)
+    {
+        if (! TapDancer::stateParameters[i].inPresets)
+            continue;
+
+        auto* param = treeState.getParameter(TapDancer::stateParameters[i].id);
+        values[i] = param->convertFrom0to1(param->getDefaultValue());
+    }
+
+    for (auto& [id, value] : presetBank[static_cast<size_t>(index)].values)
+    {
+        for (size_t i = 0; i < TapDancer::stateParameters.size(); ++i)
+        {
+            if (juce::String(TapDancer::stateParameters[i].id) == id)
+                values[i] = value;
+        }
+    }
+
+    applyStateValues(values);
 }
 
 const juce::String AudioPluginAudioProcessor::getProgramName (int index)
 {
-    juce::ignoreUnused (index);
-    return {};
+    return juce::isPositiveAndBelow(index, getNumPrograms()) ? presetBank[static_cast<size_t>(index)].name : juce::String();
 }
 
 void AudioPluginAudioProcessor::changeProgramName (int index, const juce::String& newName)
 {
-    juce::ignoreUnused (index, newName);
+    if (juce::isPositiveAndBelow(index, getNumPrograms()))
+        presetBank[static_cast<size_t>(index)].name = newName;
+}
+
+TapDancer::StateValues AudioPluginAudioProcessor::getStateValues() const
+{
+    TapDancer::StateValues values{};
+    for (size_t i = 0; i < TapDancer::stateParameters.size(); ++i)
+        values[i] = treeState.getRawParameterValue(TapDancer::stateParameters[i].id)->load();
+
+    return values;
+}
+
+void AudioPluginAudioProcessor::applyStateValues (const TapDancer::StateValues& values)
+{
+    // The audio thread keeps its snapshot until every value is in, then
+    // takes the whole set at once. The fence orders the start before the
+    // first value, so a read that sees any of them also sees the start.
+    presetLoadsStarted.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i = 0; i < TapDancer::stateParameters.size(); ++i)
+    {
+        auto* param = treeState.getParameter(TapDancer::stateParameters[i].id);
+        param->setValueNotifyingHost(param->convertTo0to1(values[i]));
+    }
+
+    auto snapshot = std::make_unique<TapDancer::ParameterSnapshot>();
+    parameterCache.read(*snapshot);
+    presetChanges.publish(std::move(snapshot));
+
+    presetLoadsFinished.fetch_add(1, std::memory_order_release);
 }
 
 //==============================================================================
@@ -131,33 +195,94 @@ void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
     // initialisation that you need..
     juce::ignoreUnused (sampleRate, samplesPerBlock);
     juce::dsp::ProcessSpec spec;
-    spec.maximumBlockSize = samplesPerBlock;
+    spec.maximumBlockSize = static_cast<juce::uint32>(subBlockSize);
     spec.numChannels = getTotalNumOutputChannels();
     spec.sampleRate = sampleRate;
     lastSampleRate = sampleRate;
+    subBlocks.prepare(static_cast<int>(spec.numChannels), subBlockSize);
+    setLatencySamples(subBlocks.getLatency());
 
     // Prepara estágio de preamp
     preamp.prepare(spec);
 
-    // Prepara delay multi-tap
-    tapsDelay.prepare(spec, sampleRate);
+    // The taps and the diffuser may run at a lower internal rate, see
+    // setWetDownsampling(), so everything from here to the output stage is
+    // prepared for that rate and its block size
+    auto factor = wetDownsampling.load() ? Utils::RateConverter::getFactorFor(sampleRate) : 1;
+    wetRateConverter.prepare(static_cast<int>(spec.numChannels), subBlockSize, factor);
+    wetSampleRate = sampleRate / factor;
+    wetRateScale = 1.f / static_cast<float>(factor);
+    maxBlockSize = wetRateConverter.getMaxInternalBlockSize();
+
+    auto wetSpec = spec;
+    wetSpec.sampleRate = wetSampleRate;
+    wetSpec.maximumBlockSize = static_cast<juce::uint32>(maxBlockSize);
+
+    // Prepara LFOs de modulação, one phase per channel pair
+    lfoBank.prepare(wetSampleRate, maxBlockSize, numLfoVoices, Utils::getNumChannelPairs(static_cast<int>(spec.numChannels)));
+
+    // Delay lines are sized from the real parameter ranges and share one arena
+    delayArena.clear();
+
+    // Prepara delay multi-tap. The LFO swings the taps from 0 to twice the depth.
+    auto maxTime = treeState.getParameterRange("TIME_ID").end;
+    auto maxSpread = treeState.getParameterRange("TSPREAD_ID").end;
+    auto maxModulation = treeState.getParameterRange("MOD_ID").end * wetRateScale;
+    tapsDelay.prepare(wetSpec, wetSampleRate, maxTime, maxSpread, 2.f * maxModulation * tapsModulationDepth);
+    tapsDelay.registerDelayMemory(delayArena);
 
     // Prepara difusor
     decayAmountMixer.reset();
-    decayAmountMixer.prepare(spec);
+    decayAmountMixer.prepare(wetSpec);
     decayAmountMixer.setMixingRule(juce::dsp::DryWetMixingRule::balanced);
     decayAmountMixer.setWetMixProportion(.0f);
 
-    diffuser1stStage.prepare(spec, sampleRate);
-    diffuser2stStage.prepare(spec, sampleRate);
+    auto maxDecay = (treeState.getParameterRange("DIFFUSER_ID").end * diffuserDecayScale + diffuserDecayOffset) * wetRateScale;
+    diffuser1stStage.prepare(wetSpec, wetSampleRate, maxDecay, maxModulation * diffuserModulationDepth);
+    diffuser2stStage.prepare(wetSpec, wetSampleRate, maxDecay, maxModulation * diffuserModulationDepth);
+    fdnVerb.prepare(wetSpec, wetSampleRate, maxDecay * fdnSizeScale, maxModulation * diffuserModulationDepth);
+
+    // Only one diffuser engine runs at a time, so their lines overlap and
+    // the arena only holds the larger one; switching engines resets them
+    delayArena.setAlternative(allpassDiffuser);
+    diffuser1stStage.registerDelayMemory(delayArena, Utils::Stage::diffuser1stStage);
+    diffuser2stStage.registerDelayMemory(delayArena, Utils::Stage::diffuser2ndStage);
+    delayArena.setAlternative(fdnDiffuser);
+    fdnVerb.registerDelayMemory(delayArena, Utils::Stage::fdnVerb);
+    delayArena.setAlternative(Utils::DelayArena::always);
+    convolutionVerb.prepare(wetSpec);
+    delayArena.allocate();
+    diffuser2stStageBuffer.setSize(static_cast<int>(spec.numChannels), maxBlockSize);
+    diffuser2stStageBuffer.clear();
+    diffuserFeedback.setSize(static_cast<int>(spec.numChannels), juce::jmax(maxBlockSize, juce::roundToInt(diffuserFeedbackDelay * wetRateScale)));
+    diffuserFeedback.clear();
+    diffuserFeedbackPosition = 0;
 
     // Prepara controles de saída
     dryWetMixer.reset();
     dryWetMixer.prepare(spec);
     dryWetMixer.setMixingRule(juce::dsp::DryWetMixingRule::balanced);
 
-    lowCutFilter.reset();
-    lowCutFilter.prepare(spec);
+    lowCutFilter.prepare(static_cast<int>(spec.numChannels));
+    Utils::prepareFirstOrderHighPass(lowCutTable, lastSampleRate);
+    lowCutFilter.setCoefficients(lowCutTable.lookup(lowCutFrequency));
+
+    // Freshly prepared blocks start out at their defaults, so push the tier
+    // and every parameter again
+    qualityGovernor.reset();
+    applyQuality(quality);
+    pendingParams = TapDancer::allParams;
+
+    preampGate.reset();
+    tapsGate.reset();
+    diffuserGate.reset();
+    tailNeedsUpdate = true;
+
+    // The parameters already hold any preset that was on its way in
+    presetFade = noFade;
+
+    stageMeter.prepare(sampleRate);
+    updateOfflinePool();
 }
 
 void AudioPluginAudioProcessor::releaseResources()
@@ -166,18 +291,41 @@ void AudioPluginAudioProcessor::releaseResources()
     // spare memory, etc.
 }
 
+void AudioPluginAudioProcessor::setNonRealtime (bool nonRealtime) noexcept
+{
+    AudioProcessor::setNonRealtime(nonRealtime);
+
+    // Never swap the workers under a running processBlock
+    const juce::ScopedLock lock(getCallbackLock());
+    updateOfflinePool();
+}
+
+void AudioPluginAudioProcessor::updateOfflinePool()
+{
+    // The calling thread takes tasks as well. The widest stage is the taps,
+    // one task per tap and channel pair; the others run one per pair, so
+    // more workers than that would idle.
+    auto maxTasks = tapsDelay.getMaxTasks(getTotalNumOutputChannels());
+    auto numThreads = juce::jmin(juce::SystemStats::getNumCpus(), maxTasks);
+    offlinePool.start(isNonRealtime() ? juce::jmax(0, numThreads - 1) : 0);
+}
+
 bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
 {
   #if JucePlugin_IsMidiEffect
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
+    // Mono, stereo and the common surround beds. Every stage runs the
+    // channels in pairs, so state and CPU grow with the channel count.
     // Some plugin hosts, such as certain GarageBand versions, will only
     // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    const auto output = layouts.getMainOutputChannelSet();
+    if (output != juce::AudioChannelSet::mono()
+     && output != juce::AudioChannelSet::stereo()
+     && output != juce::AudioChannelSet::create5point1()
+     && output != juce::AudioChannelSet::create7point1()
+     && output != juce::AudioChannelSet::create7point1point4())
         return false;
 
     // This checks if the input layout matches the output layout
@@ -190,79 +338,268 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
   #endif
 }
 
-void AudioPluginAudioProcessor::updatePreampParams()
+void AudioPluginAudioProcessor::updateQuality()
 {
-    float saturation = *treeState.getRawParameterValue("SATURATE_ID");
-    preamp.setSaturation(saturation);
+    auto selected = static_cast<Utils::Quality>(params.quality);
 
-    float tone = *treeState.getRawParameterValue("TONE_ID");
-    preamp.setToneFrequency(tone);
+    // Offline renders have no deadline, so the governor only acts in real time
+    governorEnabled = params.governor && ! isNonRealtime();
+    auto tier = governorEnabled ? qualityGovernor.limit(selected) : selected;
 
-    float gain = *treeState.getRawParameterValue("GAIN_ID");
-    preamp.setOutputGain(gain);
+    if (tier != quality)
+        applyQuality(tier);
 }
 
-void AudioPluginAudioProcessor::updateTapsDelayParams()
+// Runs after the stages have their parameters for the block.
+void AudioPluginAudioProcessor::updateTailLength()
 {
-    float taps = *treeState.getRawParameterValue("TAPS_ID");
-    tapsDelay.setDelayTaps(taps);
-
-    float feedback = *treeState.getRawParameterValue("FEEDBACK_ID");
-    tapsDelay.setDelayFeedback(feedback);
+    constexpr auto threshold = Utils::SilenceGate::threshold;
+
+    auto tapsTail = params.taps > 0 ? tapsDelay.getTailInSamples(threshold) : 0.f;
+    tapsGate.setTailLength(tapsTail);
+
+    // On top of both stages' own ring, the wet path goes round the feedback
+    // between them until that has faded too. The network has no such feedback.
+    auto blockRepeats = std::ceil(std::log(threshold) / std::log(diffuserBlockFeedback));
+    auto diffuserTail = diffuserType == fdnDiffuser         ? fdnVerb.getTailInSamples(threshold)
+                      : diffuserType == convolutionDiffuser ? convolutionVerb.getTailInSamples()
+                      : diffuser1stStage.getTailInSamples(threshold)
+                        + diffuser2stStage.getTailInSamples(threshold)
+                        + blockRepeats * static_cast<float>(diffuserFeedback.getNumSamples());
+    diffuserGate.setTailLength(diffuserTail);
+
+    auto tail = tapsTail + (params.diffusion > 0 ? diffuserTail : 0.f);
+    tailLengthSeconds.store(tail / wetSampleRate, std::memory_order_relaxed);
+}
 
-    bool t1HasFeedback = *treeState.getRawParameterValue("TAP1F_ID") > .5f;
-    bool t2HasFeedback = *treeState.getRawParameterValue("TAP2F_ID") > .5f;
-    bool t3HasFeedback = *treeState.getRawParameterValue("TAP3F_ID") > .5f;
-    tapsDelay.setTapsFeeback(t1HasFeedback, t2HasFeedback, t3HasFeedback);
+void AudioPluginAudioProcessor::lapStage(Utils::Stage stage)
+{
+    stageMeter.lap(stage);
+    if (stageProfiler != nullptr)
+        stageProfiler->lap(stage);
+}
 
-    float width = *treeState.getRawParameterValue("WIDTH_ID");
-    tapsDelay.setDelayPanWidth(width);
+bool AudioPluginAudioProcessor::takePending(TapDancer::ParameterGroup group)
+{
+    if ((pendingParams & group) == 0)
+        return false;
 
-    float time = *treeState.getRawParameterValue("TIME_ID");
-    tapsDelay.setDelayTime(time);
+    pendingParams &= ~static_cast<uint32_t>(group);
+    return true;
+}
 
-    float spread = *treeState.getRawParameterValue("TSPREAD_ID");
-    tapsDelay.setDelaySpread(spread);
+void AudioPluginAudioProcessor::applyQuality(Utils::Quality tier)
+{
+    quality = tier;
+    preamp.setQuality(quality);
+    tapsDelay.setQuality(quality);
+    diffuser1stStage.setQuality(quality);
+    diffuser2stStage.setQuality(quality);
+}
 
-    float modulation = *treeState.getRawParameterValue("MOD_ID");
-    tapsDelay.setTapsModulation(modulation * 1.5f, modulation * 100.f);
+void AudioPluginAudioProcessor::updatePreampParams()
+{
+    preamp.setSaturation(params.saturation);
+    preamp.setToneFrequency(params.tone);
+    preamp.setOutputGain(params.gain);
+}
 
-    float damp = *treeState.getRawParameterValue("DAMP_ID");
-    tapsDelay.setTapsDamping(damp);
+void AudioPluginAudioProcessor::updateTapsDelayParams()
+{
+    tapsDelay.setDelayTaps(params.taps);
+    tapsDelay.setDelayFeedback(params.feedback);
+    tapsDelay.setTapsFeeback(params.tap1Feedback, params.tap2Feedback, params.tap3Feedback);
+    tapsDelay.setDelayPanWidth(params.width);
+    tapsDelay.setDelayTime(params.time);
+    tapsDelay.setDelaySpread(params.spread);
+
+    lfoBank.setFrequency(tapsLfo, params.modulation * 1.5f);
+    tapsDelay.setTapsModulation(params.modulation * tapsModulationDepth * wetRateScale);
+    tapsDelay.setTapsDamping(params.damp);
 }
 
 void AudioPluginAudioProcessor::updateBasicVerbParams()
 {
-    float decay = *treeState.getRawParameterValue("DIFFUSER_ID");
-    decayAmountMixer.setWetMixProportion(static_cast<float>(std::tanh(decay * 1.5f)));
+    decayAmountMixer.setWetMixProportion(static_cast<float>(std::tanh(params.diffusion * 1.5f)));
+
+    float decayTransposed = ((params.diffusion * diffuserDecayScale) + diffuserDecayOffset) * wetRateScale;
+    float modulationDepth = params.modulation * diffuserModulationDepth * wetRateScale;
+
+    // Whichever engine is switched in starts from silence, and not from
+    // what the other one left in the delay memory they share
+    if (params.diffuserType != diffuserType)
+    {
+        diffuserType = params.diffuserType;
+        diffuser1stStage.reset();
+        diffuser2stStage.reset();
+        diffuserFeedback.clear();
+        fdnVerb.reset();
+        convolutionVerb.reset();
+    }
 
-    float decayTransposed = (decay * 1200.f) + 600.f;
-    float modulation = *treeState.getRawParameterValue("MOD_ID");
-    float damp = *treeState.getRawParameterValue("DAMP_ID");
+    lfoBank.setFrequency(diffuserLfo, params.modulation * 1.4f);
 
-    diffuser1stStage.updateParams(decayTransposed, damp, modulation * 1.4f, modulation * 40.f);
-    diffuser2stStage.updateParams(decayTransposed, damp, modulation * 1.4f, modulation * -40.f);
+    if (diffuserType == fdnDiffuser)
+    {
+        fdnVerb.updateParams(decayTransposed * fdnSizeScale, params.diffusion * fdnDecayScale + fdnDecayOffset,
+                             params.damp, modulationDepth);
+    }
+    else
+    {
+        diffuser1stStage.updateParams(decayTransposed, params.damp, modulationDepth);
+        diffuser2stStage.updateParams(decayTransposed, params.damp, -modulationDepth);
+    }
 }
 
 void AudioPluginAudioProcessor::updateOutputParams()
 {
-    float dryWetMix = *treeState.getRawParameterValue("DRYWET_ID");
-    if (dryWetMix != dryWetProportion)
+    if (params.dryWet != dryWetProportion)
     {
-        dryWetProportion = dryWetMix;
-        dryWetMixer.setWetMixProportion(dryWetMix);
+        dryWetProportion = params.dryWet;
+        dryWetMixer.setWetMixProportion(dryWetProportion);
     }
 
-    float lowCutFreq = *treeState.getRawParameterValue("LOWCUT_ID");
-    if (lowCutFreq != lowCutFrequency)
+    if (params.lowCut != lowCutFrequency)
+    {
+        lowCutFrequency = params.lowCut;
+        lowCutFilter.setCoefficients(lowCutTable.lookup(lowCutFrequency));
+    }
+
+    outGain = params.outputGain;
+}
+
+template <typename Variant>
+void AudioPluginAudioProcessor::processChain (juce::AudioBuffer<float>& buffer)
+{
+    // Preamp Stage
+    if (takePending(TapDancer::preampParams))
+        updatePreampParams();
+
+    if (preampGate.shouldProcess(buffer))
     {
-        lowCutFrequency = lowCutFreq;
-        *lowCutFilter.state = *juce::dsp::IIR::Coefficients<float>::makeFirstOrderHighPass(lastSampleRate, lowCutFrequency);
+        preamp.process(buffer);
+        if (preampGate.checkOutput(buffer))
+            preamp.reset();
     }
 
-    float outputGain = *treeState.getRawParameterValue("OUTPUT_ID");
-    if (outputGain != outGain)
-        outGain = outputGain;
+    lapStage(Utils::Stage::preamp);
+
+    // The wet path may run at a lower rate, see setWetDownsampling(). A short
+    // host block can leave it nothing to do at that rate.
+    if (wetRateConverter.isActive())
+    {
+        auto& wet = wetRateConverter.down(buffer);
+        if (wet.getNumSamples() > 0)
+            processWetPath<Variant>(wet);
+
+        wetRateConverter.up(buffer);
+    }
+    else
+    {
+        processWetPath<Variant>(buffer);
+    }
+}
+
+template <typename Variant>
+void AudioPluginAudioProcessor::processWetPath (juce::AudioBuffer<float>& buffer)
+{
+    auto totalNumOutputChannels = buffer.getNumChannels();
+    auto numSamples = buffer.getNumSamples();
+
+    // With no modulation both LFOs sit at 0 Hz and every reader ignores them
+    if constexpr (Variant::isModulated)
+        lfoBank.process(numSamples);
+
+    // Multi Tap Delay Stage. Its parameters stay pending while no tap is
+    // mixed in, and the LFOs keep running while it sleeps, so it wakes up
+    // in phase.
+    if constexpr (Variant::hasTaps)
+    {
+        if (takePending(TapDancer::tapsParams))
+            updateTapsDelayParams();
+
+        if (tapsGate.shouldProcess(buffer))
+        {
+            tapsDelay.process(buffer, Variant::isModulated ? lfoBank.getModulation(tapsLfo) : Utils::Modulation(), offlinePool);
+            if (tapsGate.checkOutput(buffer))
+                tapsDelay.reset();
+        }
+        else
+        {
+            // Asleep, the taps would only have output silence
+            buffer.clear();
+        }
+    }
+    else
+    {
+        buffer.clear();
+    }
+
+    lapStage(Utils::Stage::tapsDelay);
+
+    // Diffusion Stage. Its parameters stay pending while it is bypassed.
+    if constexpr (Variant::hasDiffuser)
+    {
+        if (takePending(TapDancer::diffuserParams))
+            updateBasicVerbParams();
+
+        auto diffuserModulation = Variant::isModulated ? lfoBank.getModulation(diffuserLfo) : Utils::Modulation();
+
+        // A newly loaded impulse response comes with its own tail
+        if (convolutionVerb.update())
+            tailNeedsUpdate = true;
+
+        if (diffuserGate.shouldProcess(buffer))
+        {
+            decayAmountMixer.pushDrySamples(juce::dsp::AudioBlock<float>(buffer));
+
+            if (diffuserType == convolutionDiffuser)
+            {
+                convolutionVerb.process(buffer);
+                decayAmountMixer.mixWetSamples(juce::dsp::AudioBlock<float>(buffer));
+
+                if (diffuserGate.checkOutput(buffer))
+                    convolutionVerb.reset();
+
+                lapStage(Utils::Stage::diffuser1stStage);
+            }
+            else if (diffuserType == fdnDiffuser)
+            {
+                fdnVerb.process(buffer, diffuserModulation, offlinePool);
+                decayAmountMixer.mixWetSamples(juce::dsp::AudioBlock<float>(buffer));
+
+                if (diffuserGate.checkOutput(buffer))
+                    fdnVerb.reset();
+
+                lapStage(Utils::Stage::fdnVerb);
+            }
+            else
+            {
+                // Both stages and the feedback between them sleep as one
+                feedDiffuser(buffer);
+                diffuser1stStage.process(buffer, diffuserModulation, offlinePool);
+
+                lapStage(Utils::Stage::diffuser1stStage);
+
+                diffuser2stStageBuffer.setSize(totalNumOutputChannels, numSamples, false, false, true);
+                for (int channel = 0; channel < totalNumOutputChannels; ++channel)
+                    diffuser2stStageBuffer.copyFrom(channel, 0, buffer, channel, 0, numSamples);
+                diffuser2stStage.process(diffuser2stStageBuffer, diffuserModulation, offlinePool);
+                storeDiffuserFeedback(diffuser2stStageBuffer);
+                decayAmountMixer.mixWetSamples(juce::dsp::AudioBlock<float>(buffer));
+
+                // The second stage's output comes back later, so it has to be quiet too
+                if (Utils::SilenceGate::isSilent(diffuser2stStageBuffer) && diffuserGate.checkOutput(buffer))
+                {
+                    diffuser1stStage.reset();
+                    diffuser2stStage.reset();
+                    diffuserFeedback.clear();
+                }
+
+                lapStage(Utils::Stage::diffuser2ndStage);
+            }
+        }
+    }
 }
 
 void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
@@ -271,44 +608,180 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     juce::ignoreUnused (midiMessages);
 
     juce::ScopedNoDenormals noDenormals;
+
+    // Offline renders wait on the worker pool, which is allowed to lock
+    Utils::ScopedRealtimeSection realtimeSection(! isNonRealtime());
+    auto blockStartTicks = juce::Time::getHighResolutionTicks();
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
     auto numSamples = buffer.getNumSamples();
-    dryWetMixer.pushDrySamples(juce::dsp::AudioBlock<float>(buffer));
+
+    stageMeter.beginBlock(numSamples);
+    if (stageProfiler != nullptr)
+        stageProfiler->beginBlock(numSamples);
 
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    // Preamp Stage
-    updatePreampParams();
-    preamp.process(buffer);
+    subBlocks.process(buffer, [this] (juce::AudioBuffer<float>& subBlock) { processSubBlock(subBlock); });
 
-    // Multi Tap Delay Stage
-    updateTapsDelayParams();
-    tapsDelay.process(buffer);
+    stageMeter.endBlock();
 
-    // Diffusion Stage
-    float diffusion = *treeState.getRawParameterValue("DIFFUSER_ID");
-    if (diffusion > 0)
+    if (governorEnabled)
+        qualityGovernor.addBlock(juce::Time::getHighResolutionTicks() - blockStartTicks, numSamples, lastSampleRate);
+}
+
+void AudioPluginAudioProcessor::readParameters()
+{
+    // A preset or state on its way in starts a fade, and the parameters
+    // wait until it is over
+    auto loadsStarted = presetLoadsStarted.load(std::memory_order_acquire);
+    auto presetLoadingNow = loadsStarted != presetLoadsFinished.load(std::memory_order_acquire);
+    if (presetFade == noFade && presetChanges.update())
+        presetFade = fadingOut;
+
+    // One read of every parameter per sub-block; stages whose parameters did
+    // not move skip their setters. A load that started while the values
+    // were read may have torn them, so the read is dropped; the load's own
+    // snapshot brings every group with it.
+    if (presetFade == noFade && ! presetLoadingNow)
     {
-        updateBasicVerbParams();
-        decayAmountMixer.pushDrySamples(juce::dsp::AudioBlock<float>(buffer));
-        if (diffuser2stStageBuffer.getNumSamples() > 0)
+        TapDancer::ParameterSnapshot next;
+        auto changedParams = parameterCache.update(next);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (presetLoadsStarted.load(std::memory_order_relaxed) == loadsStarted)
         {
-            for (int channel = 0; channel < totalNumOutputChannels; ++channel)
-                buffer.addFromWithRamp(channel, 0, diffuser2stStageBuffer.getReadPointer(channel), numSamples, .6f, .6f);
+            params = next;
+            pendingParams |= changedParams;
+            tailNeedsUpdate |= (changedParams & (TapDancer::tapsParams | TapDancer::diffuserParams)) != 0;
         }
-        diffuser1stStage.process(buffer);
-        diffuser2stStageBuffer.makeCopyOf(buffer);
-        diffuser2stStage.process(diffuser2stStageBuffer);
-        decayAmountMixer.mixWetSamples(juce::dsp::AudioBlock<float>(buffer));
     }
+    updateQuality();
+}
+
+void AudioPluginAudioProcessor::processSubBlock (juce::AudioBuffer<float>& buffer)
+{
+    readParameters();
+
+    dryWetMixer.pushDrySamples(juce::dsp::AudioBlock<float>(buffer));
+
+    // Pick the chain for this block once; the stages inside are specialised
+    // for it, down to the per-sample loops
+    Utils::withFlag(params.taps > 0, [&] (auto taps) {
+        Utils::withFlag(params.diffusion > 0, [&] (auto diffuser) {
+            Utils::withFlag(params.modulation > 0, [&] (auto modulated) {
+                processChain<ChainVariant<decltype(taps)::value, decltype(diffuser)::value, decltype(modulated)::value>>(buffer);
+            });
+        });
+    });
+
+    // Tails follow the parameters the stages were just given; the gates pick
+    // them up from the next block
+    if (tailNeedsUpdate)
+    {
+        updateTailLength();
+        tailNeedsUpdate = false;
+    }
+
+    if (presetFade != noFade)
+        applyPresetFade(buffer);
 
-    updateOutputParams();
-    juce::dsp::AudioBlock<float> block(buffer);
-    lowCutFilter.process(juce::dsp::ProcessContextReplacing<float>(block));
+    if (takePending(TapDancer::outputParams))
+        updateOutputParams();
+    lowCutFilter.process(buffer);
     dryWetMixer.mixWetSamples(juce::dsp::AudioBlock<float>(buffer));
-    buffer.applyGain(outGain);
+
+    // Ramped, so a preset that changes the output gain does not click
+    buffer.applyGainRamp(0, buffer.getNumSamples(), lastOutGain, outGain);
+    lastOutGain = outGain;
+
+    lapStage(Utils::Stage::output);
+}
+
+void AudioPluginAudioProcessor::applyPresetFade (juce::AudioBuffer<float>& buffer)
+{
+    // The wet path fades out on the old snapshot, which the stages get to
+    // replace once it is silent, and back in on the new one
+    if (presetFade == fadingOut)
+    {
+        buffer.applyGainRamp(0, buffer.getNumSamples(), 1.f, 0.f);
+
+        params = *presetChanges.get();
+        pendingParams = TapDancer::allParams;
+        tailNeedsUpdate = true;
+        presetFade = fadingIn;
+    }
+    else
+    {
+        buffer.applyGainRamp(0, buffer.getNumSamples(), 0.f, 1.f);
+        presetFade = noFade;
+    }
+}
+
+void AudioPluginAudioProcessor::feedDiffuser (juce::AudioBuffer<float>& buffer)
+{
+    // What the second stage wrote diffuserFeedback's length ago; a block is
+    // never longer than that, so it reads before the same slots are written
+    auto numSamples = buffer.getNumSamples();
+    auto first = juce::jmin(numSamples, diffuserFeedback.getNumSamples() - diffuserFeedbackPosition);
+
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+    {
+        buffer.addFrom(channel, 0, diffuserFeedback, channel, diffuserFeedbackPosition, first, diffuserBlockFeedback);
+        buffer.addFrom(channel, first, diffuserFeedback, channel, 0, numSamples - first, diffuserBlockFeedback);
+    }
+}
+
+void AudioPluginAudioProcessor::storeDiffuserFeedback (const juce::AudioBuffer<float>& output)
+{
+    auto numSamples = output.getNumSamples();
+    auto first = juce::jmin(numSamples, diffuserFeedback.getNumSamples() - diffuserFeedbackPosition);
+
+    for (int channel = 0; channel < output.getNumChannels(); ++channel)
+    {
+        diffuserFeedback.copyFrom(channel, diffuserFeedbackPosition, output, channel, 0, first);
+        diffuserFeedback.copyFrom(channel, 0, output, channel, first, numSamples - first);
+    }
+
+    diffuserFeedbackPosition = (diffuserFeedbackPosition + numSamples) % diffuserFeedback.getNumSamples();
+}
+
+void AudioPluginAudioProcessor::updateTrackProperties (const TrackProperties& properties)
+{
+    const juce::ScopedLock lock(trackNameLock);
+    trackName = properties.name;
+}
+
+juce::String AudioPluginAudioProcessor::getInstanceName() const
+{
+    auto name = "TapDancer #" + juce::String(instanceNumber);
+
+    const juce::ScopedLock lock(trackNameLock);
+    return trackName.isEmpty() ? name : name + " on " + trackName;
+}
+
+void AudioPluginAudioProcessor::loadImpulseResponse (const juce::File& file)
+{
+    treeState.state.setProperty("IR_FILE", file.getFullPathName(), nullptr);
+    convolutionVerb.loadImpulseResponse(file);
+}
+
+void AudioPluginAudioProcessor::setWetDownsampling (bool shouldDownsample)
+{
+    if (wetDownsampling.exchange(shouldDownsample) == shouldDownsample)
+        return;
+
+    treeState.state.setProperty("WET_DOWNSAMPLE", shouldDownsample, nullptr);
+
+    // The wet path's delay lines are sized for its rate, so this takes a
+    // fresh prepare, with the audio callback held off meanwhile
+    if (getSampleRate() > 0.0)
+    {
+        suspendProcessing(true);
+        prepareToPlay(getSampleRate(), getBlockSize());
+        suspendProcessing(false);
+    }
 }
 
 //==============================================================================
@@ -319,23 +792,39 @@ bool AudioPluginAudioProcessor::hasEditor() const
 
 juce::AudioProcessorEditor* AudioPluginAudioProcessor::createEditor()
 {
-    return new juce::GenericAudioProcessorEditor(*this);
+    return new AudioPluginAudioProcessorEditor(*this);
 }
 
 //==============================================================================
 void AudioPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
-    juce::ignoreUnused (destData);
+    TapDancer::State state;
+    state.values = getStateValues();
+    state.wetDownsampling = isWetDownsampling();
+    state.program = currentProgram;
+    state.impulseResponse = getImpulseResponseFile().getFullPathName();
+    state.write(destData);
 }
 
 void AudioPluginAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
-    juce::ignoreUnused (data, sizeInBytes);
+    // Values an older state does not have take their defaults
+    TapDancer::State state;
+    for (size_t i = 0; i < TapDancer::stateParameters.size(); ++i)
+    {
+        auto* param = treeState.getParameter(TapDancer::stateParameters[i].id);
+        state.values[i] = param->convertFrom0to1(param->getDefaultValue());
+    }
+
+    if (! state.read(data, sizeInBytes))
+        return;
+
+    currentProgram = juce::jlimit(0, getNumPrograms() - 1, state.program);
+    applyStateValues(state.values);
+    setWetDownsampling(state.wetDownsampling);
+
+    if (state.impulseResponse.isNotEmpty() && juce::File::isAbsolutePath(state.impulseResponse))
+        loadImpulseResponse(juce::File(state.impulseResponse));
 }
 
 //==============================================================================
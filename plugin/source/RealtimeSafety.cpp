@@ -0,0 +1,165 @@
+#include "Utils/RealtimeSafety.h"
+
+#if TAPDANCER_REALTIME_CHECK
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(__linux__)
+ #include <dlfcn.h>
+ #include <pthread.h>
+#endif
+
+#ifndef TAPDANCER_REALTIME_CHECK_ABORT
+ #define TAPDANCER_REALTIME_CHECK_ABORT 0
+#endif
+
+namespace
+{
+    thread_local int realtimeDepth = 0;
+    thread_local int reportingDepth = 0;
+    std::atomic<int> violationCount{ 0 };
+
+    void reportViolation(const char* what) noexcept
+    {
+        if (realtimeDepth == 0 || reportingDepth > 0)
+            return;
+
+        violationCount.fetch_add(1, std::memory_order_relaxed);
+
+        // Reporting must not recurse into the check, so it is ignored while printing.
+        ++reportingDepth;
+        std::fprintf(stderr, "TapDancer: %s called on the audio thread\n", what);
+        --reportingDepth;
+
+       #if TAPDANCER_REALTIME_CHECK_ABORT
+        std::abort();
+       #endif
+    }
+
+    void* allocate(std::size_t size)
+    {
+        reportViolation("operator new");
+
+        if (auto* ptr = std::malloc(size == 0 ? 1 : size))
+            return ptr;
+
+        throw std::bad_alloc();
+    }
+
+    void release(void* ptr) noexcept
+    {
+        if (ptr == nullptr)
+            return;
+
+        reportViolation("operator delete");
+        std::free(ptr);
+    }
+
+    // Over-allocates with malloc and keeps the original pointer just before the
+    // aligned block, which works the same way on every platform we build for.
+    void* allocateAligned(std::size_t size, std::align_val_t alignment)
+    {
+        reportViolation("operator new");
+
+        auto align = static_cast<std::size_t>(alignment);
+        auto* raw = std::malloc(size + align + sizeof(void*));
+        if (raw == nullptr)
+            throw std::bad_alloc();
+
+        auto address = reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*);
+        address = (address + align - 1) & ~(static_cast<std::uintptr_t>(align) - 1);
+
+        auto* aligned = reinterpret_cast<void*>(address);
+        static_cast<void**>(aligned)[-1] = raw;
+        return aligned;
+    }
+
+    void releaseAligned(void* ptr) noexcept
+    {
+        if (ptr == nullptr)
+            return;
+
+        reportViolation("operator delete");
+        std::free(static_cast<void**>(ptr)[-1]);
+    }
+}
+
+namespace Utils
+{
+    ScopedRealtimeSection::ScopedRealtimeSection(bool isRealtime) : active(isRealtime)
+    {
+        if (active)
+            ++realtimeDepth;
+    }
+
+    ScopedRealtimeSection::~ScopedRealtimeSection()
+    {
+        if (active)
+            --realtimeDepth;
+    }
+
+    int getRealtimeViolationCount()
+    {
+        return violationCount.load(std::memory_order_relaxed);
+    }
+}
+
+//==============================================================================
+// Global replacements. The array and nothrow forms all forward to these by
+// default, so replacing them is enough to see every allocation in the process.
+void* operator new(std::size_t size)                                        { return allocate(size); }
+void operator delete(void* ptr) noexcept                                    { release(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept                       { release(ptr); }
+void* operator new(std::size_t size, std::align_val_t alignment)            { return allocateAligned(size, alignment); }
+void operator delete(void* ptr, std::align_val_t) noexcept                  { releaseAligned(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept     { releaseAligned(ptr); }
+
+//==============================================================================
+// Lock hooks. The executable's definitions come before libc's, and each one
+// reports and then forwards to the next definition, libc's own. The pointer
+// is looked up without a function-local static, since the guard of one can
+// itself take a mutex.
+#if defined(__linux__)
+namespace
+{
+    template <typename Function>
+    Function findNext(std::atomic<Function>& next, const char* name) noexcept
+    {
+        auto function = next.load(std::memory_order_acquire);
+        if (function == nullptr)
+        {
+            function = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+            next.store(function, std::memory_order_release);
+        }
+
+        return function;
+    }
+
+    std::atomic<int (*)(pthread_mutex_t*)> nextMutexLock{ nullptr };
+    std::atomic<int (*)(pthread_rwlock_t*)> nextReadLock{ nullptr }, nextWriteLock{ nullptr };
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+{
+    reportViolation("pthread_mutex_lock");
+    return findNext(nextMutexLock, "pthread_mutex_lock")(mutex);
+}
+
+extern "C" int pthread_rwlock_rdlock(pthread_rwlock_t* lock) noexcept
+{
+    reportViolation("pthread_rwlock_rdlock");
+    return findNext(nextReadLock, "pthread_rwlock_rdlock")(lock);
+}
+
+extern "C" int pthread_rwlock_wrlock(pthread_rwlock_t* lock) noexcept
+{
+    reportViolation("pthread_rwlock_wrlock");
+    return findNext(nextWriteLock, "pthread_rwlock_wrlock")(lock);
+}
+#endif
+
+#endif
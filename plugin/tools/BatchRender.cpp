@@ -0,0 +1,389 @@
+#include "TapDancer/PluginProcessor.h"
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// Batch renderer. Streams WAV and AIFF files through the processor the way a
+// host bounce would, with parameters from a preset file, and writes each
+// result next to the others in an output folder. Files are spread over worker
+// threads, each with its own processor, so a large batch keeps every core
+// busy. Input is read a block at a time, so memory does not grow with the
+// length of the files.
+//
+// Usage:
+//   TapDancerBatch --preset=preset.json --output=rendered [--threads=8]
+//                  [--block=4096] [--tail=2] [--report=report.json]
+//                  input.wav folder ...
+//
+// The preset is a JSON object of parameter IDs and plain values, in the
+// parameter's own units:
+//   { "TIME_ID": 250, "TAPS_ID": 3, "DIFFUSER_ID": 0.6, "DIFFUSER_TYPE_ID": 2,
+//     "IR_FILE": "halls/small.wav", "WET_DOWNSAMPLE": true }
+// Choice parameters take the index of the choice. IR_FILE is the impulse
+// response for the convolution diffuser, relative to the preset file, and
+// WET_DOWNSAMPLE is the processor's wet path option.
+//
+// Folders are searched recursively and their layout is kept in the output
+// folder. Each output has the format, bit depth and metadata of its input,
+// and runs on past its end by --tail seconds, or by the processor's own tail
+// up to maxTailSeconds when --tail is not given. The exit code is 1 when any
+// file fails.
+//==============================================================================
+namespace
+{
+    constexpr double maxTailSeconds = 10.0;
+    const juce::String audioFilePatterns{ "*.wav;*.aif;*.aiff" };
+
+    struct Preset
+    {
+        juce::NamedValueSet parameters;
+        juce::File impulseResponse;
+        bool wetDownsampling{ false };
+    };
+
+    struct Settings
+    {
+        Preset preset;
+        juce::File outputDir, reportFile;
+        int numThreads{ juce::SystemStats::getNumCpus() };
+        int blockSize{ 4096 };
+        double tailSeconds{ -1.0 };
+    };
+
+    struct Job
+    {
+        juce::File input, output;
+    };
+
+    struct JobResult
+    {
+        juce::String error;
+        double audioSeconds{ 0.0 }, renderSeconds{ 0.0 };
+    };
+
+    // The bus for a file's channels. The processor takes mono, stereo and
+    // the 5.1, 7.1 and 7.1.4 beds.
+    juce::AudioChannelSet getChannelSet(int numChannels)
+    {
+        return numChannels == 12 ? juce::AudioChannelSet::create7point1point4()
+                                 : juce::AudioChannelSet::canonicalChannelSet(numChannels);
+    }
+
+    void setParameter(AudioPluginAudioProcessor& processor, const juce::String& id, float value)
+    {
+        if (auto* param = processor.treeState.getParameter(id))
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+    }
+
+    // Returns an error message, or an empty string when the preset is valid.
+    juce::String loadPreset(const juce::File& file, Preset& preset)
+    {
+        auto json = juce::JSON::parse(file);
+        auto* object = json.getDynamicObject();
+        if (object == nullptr)
+            return "Could not read the preset " + file.getFullPathName();
+
+        // Only to check the IDs against
+        AudioPluginAudioProcessor processor;
+
+        for (auto& property : object->getProperties())
+        {
+            auto id = property.name.toString();
+
+            if (id == "IR_FILE")
+                preset.impulseResponse = file.getParentDirectory().getChildFile(property.value.toString());
+            else if (id == "WET_DOWNSAMPLE")
+                preset.wetDownsampling = static_cast<bool>(property.value);
+            else if (processor.treeState.getParameter(id) != nullptr)
+                preset.parameters.set(property.name, property.value);
+            else
+                return "Unknown parameter " + id + " in " + file.getFullPathName();
+        }
+
+        if (preset.impulseResponse != juce::File() && ! preset.impulseResponse.existsAsFile())
+            return "Missing impulse response " + preset.impulseResponse.getFullPathName();
+
+        return {};
+    }
+
+    void applyPreset(AudioPluginAudioProcessor& processor, const Preset& preset)
+    {
+        for (auto& parameter : preset.parameters)
+            setParameter(processor, parameter.name.toString(), static_cast<float>(parameter.value));
+
+        // Every core is already busy with a file of its own, so the processor
+        // stays in real time mode and keeps its stages on this thread. That
+        // renders exactly what an offline bounce does, minus the deadline the
+        // governor would otherwise chase.
+        setParameter(processor, "GOVERNOR_ID", 0.f);
+
+        // Both are picked up by the first prepareToPlay
+        processor.setWetDownsampling(preset.wetDownsampling);
+        if (preset.impulseResponse != juce::File())
+            processor.loadImpulseResponse(preset.impulseResponse);
+    }
+
+    // Returns an error message, or an empty string once job.output is written.
+    juce::String renderFile(AudioPluginAudioProcessor& processor, juce::AudioFormatManager& formats,
+                            const Job& job, const Settings& settings, JobResult& result)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(job.input));
+        if (reader == nullptr)
+            return "Could not read the file";
+
+        auto numChannels = static_cast<int>(reader->numChannels);
+        auto sampleRate = reader->sampleRate;
+
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(getChannelSet(numChannels));
+        layout.outputBuses.add(getChannelSet(numChannels));
+        if (! processor.setBusesLayout(layout))
+            return juce::String(numChannels) + " channels are not supported";
+
+        auto* format = formats.findFormatForFileExtension(job.output.getFileExtension());
+        if (format == nullptr || ! job.output.getParentDirectory().createDirectory() || ! job.output.deleteFile())
+            return "Could not create " + job.output.getFullPathName();
+
+        std::unique_ptr<juce::FileOutputStream> stream(job.output.createOutputStream());
+        if (stream == nullptr)
+            return "Could not create " + job.output.getFullPathName();
+
+        auto bitDepth = format->getPossibleBitDepths().contains(static_cast<int>(reader->bitsPerSample))
+                      ? static_cast<int>(reader->bitsPerSample) : 24;
+        std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(), sampleRate, reader->numChannels,
+                                                                                bitDepth, reader->metadataValues, 0));
+        if (writer == nullptr)
+            return "Could not write " + job.output.getFullPathName();
+
+        // The writer owns the stream from here on
+        stream.release();
+
+        processor.setRateAndBufferSizeDetails(sampleRate, settings.blockSize);
+        processor.prepareToPlay(sampleRate, settings.blockSize);
+
+        juce::AudioBuffer<float> block(numChannels, settings.blockSize);
+        juce::MidiBuffer midi;
+        auto start = juce::Time::getHighResolutionTicks();
+
+        auto renderBlock = [&] (int length) {
+            processor.processBlock(block, midi);
+            return writer->writeFromAudioSampleBuffer(block, 0, length);
+        };
+
+        for (juce::int64 position = 0; position < reader->lengthInSamples; position += settings.blockSize)
+        {
+            auto length = static_cast<int>(juce::jmin(static_cast<juce::int64>(settings.blockSize), reader->lengthInSamples - position));
+            block.setSize(numChannels, length, false, false, true);
+
+            if (! reader->read(block.getArrayOfWritePointers(), numChannels, position, length) || ! renderBlock(length))
+                return "Could not render the file";
+        }
+
+        // The processor's tail is known once it has seen the parameters
+        auto tailSeconds = settings.tailSeconds >= 0.0 ? settings.tailSeconds : juce::jmin(maxTailSeconds, processor.getTailLengthSeconds());
+        auto tailSamples = static_cast<juce::int64>(std::ceil(tailSeconds * sampleRate));
+
+        for (juce::int64 position = 0; position < tailSamples; position += settings.blockSize)
+        {
+            auto length = static_cast<int>(juce::jmin(static_cast<juce::int64>(settings.blockSize), tailSamples - position));
+            block.setSize(numChannels, length, false, false, true);
+            block.clear();
+
+            if (! renderBlock(length))
+                return "Could not render the tail";
+        }
+
+        processor.releaseResources();
+
+        result.audioSeconds = static_cast<double>(reader->lengthInSamples + tailSamples) / sampleRate;
+        result.renderSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+        return {};
+    }
+
+    // Takes the next job until there are none left. The processor is built
+    // on this thread and used for every file the worker picks up.
+    class Worker : public juce::Thread
+    {
+    public:
+        Worker(const std::vector<Job>& _jobs, std::vector<JobResult>& _results, std::atomic<size_t>& _nextJob,
+               const Settings& _settings, juce::CriticalSection& _logLock)
+            : juce::Thread("TapDancer batch"), jobs(_jobs), results(_results), nextJob(_nextJob),
+              settings(_settings), logLock(_logLock)
+        {};
+
+        void run() override
+        {
+            juce::AudioFormatManager formats;
+            formats.registerBasicFormats();
+
+            AudioPluginAudioProcessor processor;
+            applyPreset(processor, settings.preset);
+
+            for (auto i = nextJob++; i < jobs.size() && ! threadShouldExit(); i = nextJob++)
+            {
+                auto& result = results[i];
+                result.error = renderFile(processor, formats, jobs[i], settings, result);
+
+                const juce::ScopedLock lock(logLock);
+                if (result.error.isEmpty())
+                    std::cerr << "Rendered " << jobs[i].output.getFullPathName() << std::endl;
+                else
+                    std::cerr << jobs[i].input.getFullPathName() << ": " << result.error << std::endl;
+            }
+        };
+
+    private:
+        const std::vector<Job>& jobs;
+        std::vector<JobResult>& results;
+        std::atomic<size_t>& nextJob;
+        const Settings& settings;
+        juce::CriticalSection& logLock;
+    };
+
+    // Files stand for themselves; folders bring every audio file below them.
+    std::vector<Job> findJobs(const juce::ArgumentList& args, const juce::File& outputDir)
+    {
+        std::vector<Job> jobs;
+        for (auto& argument : args.arguments)
+        {
+            if (argument.isOption())
+                continue;
+
+            auto path = argument.resolveAsFile();
+            if (path.isDirectory())
+            {
+                for (auto& file : path.findChildFiles(juce::File::findFiles, true, audioFilePatterns))
+                    jobs.push_back({ file, outputDir.getChildFile(file.getRelativePathFrom(path)) });
+            }
+            else
+            {
+                jobs.push_back({ path, outputDir.getChildFile(path.getFileName()) });
+            }
+        }
+
+        return jobs;
+    }
+
+    juce::String parseSettings(const juce::ArgumentList& args, Settings& settings)
+    {
+        if (! args.containsOption("--preset") || ! args.containsOption("--output"))
+            return "Usage: TapDancerBatch --preset=preset.json --output=folder [--threads=N] [--block=4096] [--tail=seconds] [--report=report.json] inputs...";
+
+        auto presetFile = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--preset"));
+        auto error = loadPreset(presetFile, settings.preset);
+        if (error.isNotEmpty())
+            return error;
+
+        settings.outputDir = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--output"));
+
+        if (args.containsOption("--threads"))
+            settings.numThreads = juce::jmax(1, args.getValueForOption("--threads").getIntValue());
+
+        if (args.containsOption("--block"))
+            settings.blockSize = juce::jmax(1, args.getValueForOption("--block").getIntValue());
+
+        if (args.containsOption("--tail"))
+            settings.tailSeconds = juce::jmax(0.0, args.getValueForOption("--tail").getDoubleValue());
+
+        if (args.containsOption("--report"))
+            settings.reportFile = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--report"));
+
+        return {};
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // The processor's parameter tree needs a message manager to exist.
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args(argc, argv);
+    Settings settings;
+
+    auto error = parseSettings(args, settings);
+    if (error.isNotEmpty())
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    auto jobs = findJobs(args, settings.outputDir);
+    for (auto& job : jobs)
+    {
+        // Never render over a source
+        if (job.output == job.input)
+        {
+            std::cerr << job.input.getFullPathName() << " is inside the output folder" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<JobResult> results(jobs.size());
+    std::atomic<size_t> nextJob{ 0 };
+    juce::CriticalSection logLock;
+    auto start = juce::Time::getHighResolutionTicks();
+
+    // No more workers than files, each with a processor of its own
+    std::vector<std::unique_ptr<Worker>> workers;
+    auto numWorkers = juce::jmin(static_cast<size_t>(settings.numThreads), jobs.size());
+    for (size_t i = 0; i < numWorkers; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>(jobs, results, nextJob, settings, logLock));
+        workers.back()->startThread();
+    }
+
+    for (auto& worker : workers)
+        worker->waitForThreadToExit(-1);
+
+    auto wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+    int failures = 0;
+    double audioSeconds = 0.0;
+    juce::Array<juce::var> files;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        auto& result = results[i];
+        failures += result.error.isNotEmpty() ? 1 : 0;
+        audioSeconds += result.audioSeconds;
+
+        auto* file = new juce::DynamicObject();
+        file->setProperty("input", jobs[i].input.getFullPathName());
+        file->setProperty("output", jobs[i].output.getFullPathName());
+        file->setProperty("error", result.error);
+        file->setProperty("audioSeconds", result.audioSeconds);
+        file->setProperty("renderSeconds", result.renderSeconds);
+        files.add(juce::var(file));
+    }
+
+    std::cerr << jobs.size() - static_cast<size_t>(failures) << " of " << jobs.size() << " files rendered, "
+              << audioSeconds << " s of audio in " << wallSeconds << " s" << std::endl;
+
+    if (settings.reportFile != juce::File())
+    {
+        auto* report = new juce::DynamicObject();
+        report->setProperty("plugin", "TapDancer");
+        report->setProperty("threads", static_cast<int>(numWorkers));
+        report->setProperty("blockSize", settings.blockSize);
+        report->setProperty("audioSeconds", audioSeconds);
+        report->setProperty("wallSeconds", wallSeconds);
+        // Audio time over wall time, for the whole batch
+        report->setProperty("speed", wallSeconds > 0.0 ? audioSeconds / wallSeconds : 0.0);
+        report->setProperty("failures", failures);
+        report->setProperty("files", files);
+
+        if (! settings.reportFile.replaceWithText(juce::JSON::toString(juce::var(report))))
+        {
+            std::cerr << "Could not write " << settings.reportFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
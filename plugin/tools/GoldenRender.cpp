@@ -0,0 +1,821 @@
+#include "TapDancer/PluginProcessor.h"
+#include "AudioProcessorBlock/BasicVerb.h"
+#include "AudioProcessorBlock/FdnVerb.h"
+#include "AudioProcessorBlock/Preamp.h"
+#include "AudioProcessorBlock/ThreeTapDelay.h"
+#include "Utils/Allpass.h"
+#include "Utils/Delay.h"
+#include "Utils/DelayArena.h"
+#include "Utils/FastMath.h"
+#include "Utils/LfoBank.h"
+#include "Utils/Saturator.h"
+#include "Utils/StereoFrame.h"
+#include "Utils/TaskPool.h"
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <functional>
+#include <iostream>
+#include <limits>
+
+//==============================================================================
+// Golden output check. Renders fixed impulse, noise and sine inputs through
+// every DSP kernel and through the whole processor, at each quality tier, and
+// compares the result with reference renders stored as 32 bit float WAVs.
+// Each kernel has its own error bound. It also checks that the approximate
+// and vectorised paths agree with their exact, scalar counterparts, which
+// needs no references at all.
+//
+// Usage:
+//   TapDancerGolden [--references=golden] [--record] [--output=report.json]
+//
+// --record writes the references instead of checking them; do that on a
+// commit whose sound is known to be right. A kernel without a reference is
+// skipped, so with no references at all only the agreement checks run,
+// which is what ctest gates on, see plugin/CMakeLists.txt. The exit code is
+// 1 when any check fails.
+//==============================================================================
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int numChannels = 2, numSamples = 48000, blockSize = 256;
+
+    //==========================================================================
+    // Largest sample difference, and the difference's RMS relative to the
+    // expected signal in dB.
+    struct Difference
+    {
+        float maxAbs{ 0.f };
+        float relativeDb{ -200.f };
+    };
+
+    Difference compare(const juce::AudioBuffer<float>& actual, const juce::AudioBuffer<float>& expected)
+    {
+        if (actual.getNumChannels() != expected.getNumChannels() || actual.getNumSamples() != expected.getNumSamples())
+            return { std::numeric_limits<float>::infinity(), 0.f };
+
+        Difference difference;
+        double errorEnergy = 0.0, signalEnergy = 0.0;
+
+        for (int channel = 0; channel < actual.getNumChannels(); ++channel)
+        {
+            auto* a = actual.getReadPointer(channel);
+            auto* e = expected.getReadPointer(channel);
+
+            for (int s = 0; s < actual.getNumSamples(); ++s)
+            {
+                auto error = a[s] - e[s];
+                difference.maxAbs = juce::jmax(difference.maxAbs, std::abs(error));
+                errorEnergy += static_cast<double>(error) * error;
+                signalEnergy += static_cast<double>(e[s]) * e[s];
+            }
+        }
+
+        if (errorEnergy > 0.0)
+            difference.relativeDb = static_cast<float>(10.0 * std::log10(errorEnergy / juce::jmax(signalEnergy, 1.0e-30)));
+
+        return difference;
+    }
+
+    //==========================================================================
+    juce::AudioBuffer<float> makeImpulse()
+    {
+        juce::AudioBuffer<float> buffer(numChannels, numSamples);
+        buffer.clear();
+
+        // Offset on the right so a channel swap shows up
+        buffer.setSample(0, 0, 1.f);
+        buffer.setSample(1, 7, 1.f);
+        return buffer;
+    }
+
+    juce::AudioBuffer<float> makeNoise()
+    {
+        juce::AudioBuffer<float> buffer(numChannels, numSamples);
+        juce::Random random(20240611);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            for (int s = 0; s < numSamples; ++s)
+                buffer.setSample(channel, s, (random.nextFloat() * 2.f - 1.f) * .5f);
+
+        return buffer;
+    }
+
+    juce::AudioBuffer<float> makeSine()
+    {
+        juce::AudioBuffer<float> buffer(numChannels, numSamples);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            auto delta = juce::MathConstants<double>::twoPi * (channel == 0 ? 220.0 : 330.0) / sampleRate;
+            for (int s = 0; s < numSamples; ++s)
+                buffer.setSample(channel, s, static_cast<float>(std::sin(delta * s)) * .5f);
+        }
+
+        return buffer;
+    }
+
+    struct Input
+    {
+        const char* name;
+        juce::AudioBuffer<float> buffer;
+    };
+
+    //==========================================================================
+    // Runs process over the input in blockSize chunks, in place on a copy, and
+    // hands it one LFO value in [-1, 1] per sample from an LfoBank, as the
+    // processor does.
+    using BlockProcess = std::function<void(juce::AudioBuffer<float>&, const float*)>;
+
+    juce::AudioBuffer<float> renderInBlocks(const juce::AudioBuffer<float>& input, const BlockProcess& process)
+    {
+        juce::AudioBuffer<float> output(input);
+
+        Utils::LfoBank lfo;
+        lfo.prepare(sampleRate, blockSize, 1);
+        lfo.setFrequency(0, .7f);
+
+        for (int start = 0; start < output.getNumSamples(); start += blockSize)
+        {
+            auto length = juce::jmin(blockSize, output.getNumSamples() - start);
+            juce::AudioBuffer<float> block(output.getArrayOfWritePointers(), output.getNumChannels(), start, length);
+
+            lfo.process(length);
+            process(block, lfo.getBlock(0));
+        }
+
+        return output;
+    }
+
+    juce::dsp::ProcessSpec makeSpec()
+    {
+        return { sampleRate, static_cast<juce::uint32>(blockSize), static_cast<juce::uint32>(numChannels) };
+    }
+
+    //== Kernels ===============================================================
+    juce::AudioBuffer<float> renderSaturate(const juce::AudioBuffer<float>& input, Utils::Quality)
+    {
+        return renderInBlocks(input, [] (juce::AudioBuffer<float>& block, const float*) {
+            for (int channel = 0; channel < block.getNumChannels(); ++channel)
+            {
+                auto* data = block.getWritePointer(channel);
+                for (int s = 0; s < block.getNumSamples(); ++s)
+                    data[s] = Utils::saturate(data[s] * 1.5f);
+            }
+        });
+    }
+
+    juce::AudioBuffer<float> renderLfoBank(const juce::AudioBuffer<float>& input, Utils::Quality)
+    {
+        Utils::LfoBank bank;
+        bank.prepare(sampleRate, blockSize, 1);
+        bank.setFrequency(0, 440.f);
+
+        // The oscillator ignores its input and is added on top of it
+        return renderInBlocks(input, [&] (juce::AudioBuffer<float>& block, const float*) {
+            bank.process(block.getNumSamples());
+            for (int channel = 0; channel < block.getNumChannels(); ++channel)
+                block.addFrom(channel, 0, bank.getBlock(0), block.getNumSamples());
+        });
+    }
+
+    juce::AudioBuffer<float> renderAllPass(const juce::AudioBuffer<float>& input, Utils::Quality tier)
+    {
+        auto spec = makeSpec();
+        Utils::DelayArena arena;
+        Utils::AllPass allPass;
+        allPass.prepare(spec, sampleRate, 512);
+        allPass.registerDelayMemory(arena, Utils::Stage::diffuser1stStage);
+        arena.allocate();
+
+        allPass.setAPSampleDelay(441.3f);
+        allPass.setFeedback(.56f);
+        allPass.setModulation(true);
+        allPass.setModAmount(20.f);
+        allPass.setQuality(tier);
+
+        return renderInBlocks(input, [&] (juce::AudioBuffer<float>& block, const float* modulation) {
+            allPass.process(block, modulation);
+        });
+    }
+
+    juce::AudioBuffer<float> renderDelay(const juce::AudioBuffer<float>& input, Utils::Quality tier)
+    {
+        auto spec = makeSpec();
+        Utils::DelayArena arena;
+        Utils::Delay delay;
+        delay.prepare(spec, sampleRate, 500.f, 40.f);
+        delay.registerDelayMemory(arena, Utils::Stage::tapsDelay);
+        arena.allocate();
+
+        delay.setDelayTime(120.f);
+        delay.setFeedback(.6f);
+        delay.setDamp(6000.f);
+        delay.setModAmount(20.f);
+        delay.setQuality(tier);
+
+        return renderInBlocks(input, [&] (juce::AudioBuffer<float>& block, const float* modulation) {
+            delay.process(block, modulation);
+        });
+    }
+
+    juce::AudioBuffer<float> renderPreamp(const juce::AudioBuffer<float>& input, Utils::Quality tier)
+    {
+        auto spec = makeSpec();
+        AudioProcessorBlock::Preamp preamp;
+        preamp.prepare(spec);
+        preamp.setSaturation(1.5f);
+        preamp.setToneFrequency(6000.f);
+        preamp.setOutputGain(.8f);
+        preamp.setQuality(tier);
+
+        return renderInBlocks(input, [&] (juce::AudioBuffer<float>& block, const float*) {
+            preamp.process(block);
+        });
+    }
+
+    juce::AudioBuffer<float> renderTaps(const juce::AudioBuffer<float>& input, Utils::Quality tier,
+                                        bool tap1Feedback, bool tap2Feedback, bool tap3Feedback)
+    {
+        auto spec = makeSpec();
+        Utils::DelayArena arena;
+        Utils::TaskPool pool;
+        AudioProcessorBlock::ThreeTapDelay taps;
+        taps.prepare(spec, sampleRate, 1000.f, 1000.f, 200.f);
+        taps.registerDelayMemory(arena);
+        arena.allocate();
+
+        taps.setQuality(tier);
+        taps.setDelayTaps(3.f);
+        taps.setDelayFeedback(.5f);
+        taps.setTapsFeeback(tap1Feedback, tap2Feedback, tap3Feedback);
+        taps.setDelayPanWidth(.5f);
+        taps.setDelayTime(250.f);
+        taps.setDelaySpread(120.f);
+        taps.setTapsModulation(50.f);
+        taps.setTapsDamping(9000.f);
+
+        return renderInBlocks(input, [&] (juce::AudioBuffer<float>& block, const float* modulation) {
+            taps.process(block, modulation, pool);
+        });
+    }
+
+    juce::AudioBuffer<float> renderThreeTapDelay(const juce::AudioBuffer<float>& input, Utils::Quality tier)
+    {
+        return renderTaps(input, tier, true, true, true);
+    }
+
+    // The same taps as renderTaps, each on a Utils::Delay of its
+    // own and panned afterwards, the way the taps were built before they
+    // shared a line.
+    juce::AudioBuffer<float> renderTapsOnDelays(const juce::AudioBuffer<float>& input, Utils::Quality tier,
+                                                bool tap1Feedback, bool tap2Feedback, bool tap3Feedback)
+    {
+        auto spec = makeSpec();
+        const bool feedback[] = { tap1Feedback, tap2Feedback, tap3Feedback };
+        const float pan[] = { .5f, -.5f, 0.f };
+
+        juce::AudioBuffer<float> output(input.getNumChannels(), input.getNumSamples());
+        output.clear();
+
+        for (int t = 0; t < 3; ++t)
+        {
+            Utils::DelayArena arena;
+            Utils::Delay delay;
+            delay.prepare(spec, sampleRate, 500.f, 100.f);
+            delay.registerDelayMemory(arena, Utils::Stage::tapsDelay);
+            arena.allocate();
+
+            delay.setDelayTime(250.f + 120.f * static_cast<float>(t));
+            delay.setFeedback(feedback[t] ? .5f : 0.f);
+            delay.setDamp(9000.f);
+            delay.setModAmount(50.f);
+            delay.setQuality(tier);
+
+            auto tap = renderInBlocks(input, [&] (juce::AudioBuffer<float>& block, const float* modulation) {
+                delay.process(block, modulation);
+            });
+
+            output.addFrom(0, 0, tap, 0, 0, tap.getNumSamples(), juce::jmin(1.f, 1.f - pan[t]));
+            output.addFrom(1, 0, tap, 1, 0, tap.getNumSamples(), juce::jmin(1.f, 1.f + pan[t]));
+        }
+
+        return output;
+    }
+
+    juce::AudioBuffer<float> renderBasicVerb(const juce::AudioBuffer<float>& input, Utils::Quality tier)
+    {
+        auto spec = makeSpec();
+        Utils::DelayArena arena;
+        Utils::TaskPool pool;
+        AudioProcessorBlock::BasicVerb verb;
+        verb.prepare(spec, sampleRate, 1800.f, 40.f);
+        verb.registerDelayMemory(arena, Utils::Stage::diffuser1stStage);
+        arena.allocate();
+
+        verb.setQuality(tier);
+        verb.updateParams(1320.f, 9000.f, 20.f);
+
+        return renderInBlocks(input, [&] (juce::AudioBuffer<float>& block, const float* modulation) {
+            verb.process(block, modulation, pool);
+        });
+    }
+
+    juce::AudioBuffer<float> renderFdnVerb(const juce::AudioBuffer<float>& input, Utils::Quality)
+    {
+        auto spec = makeSpec();
+        Utils::DelayArena arena;
+        Utils::TaskPool pool;
+        AudioProcessorBlock::FdnVerb verb;
+        verb.prepare(spec, sampleRate, 3600.f, 40.f);
+        verb.registerDelayMemory(arena, Utils::Stage::fdnVerb);
+        arena.allocate();
+
+        verb.updateParams(2640.f, 2.5f, 9000.f, 20.f);
+
+        return renderInBlocks(input, [&] (juce::AudioBuffer<float>& block, const float* modulation) {
+            verb.process(block, modulation, pool);
+        });
+    }
+
+    //== Whole processor =======================================================
+    void setParameter(AudioPluginAudioProcessor& processor, const juce::String& id, float value)
+    {
+        if (auto* param = processor.treeState.getParameter(id))
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+    }
+
+    // Block sizes a host might send in turn: odd ones, a single sample and
+    // one above what the processor was prepared for.
+    const std::vector<int> varyingBlockSizes{ 1, 63, 256, 13, 1000, 64, 65, 480 };
+
+    // A parameter move, as the host sends it: it splits its block there.
+    struct Automation
+    {
+        int position;
+        const char* id;
+        float value;
+    };
+
+    juce::AudioBuffer<float> renderProcessor(const juce::AudioBuffer<float>& input, Utils::Quality tier, bool offline,
+                                             bool varyBlockSize = false, const std::vector<Automation>& automation = {})
+    {
+        AudioPluginAudioProcessor processor;
+        processor.setNonRealtime(offline);
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        setParameter(processor, "QUALITY_ID", static_cast<float>(static_cast<int>(tier)));
+        setParameter(processor, "GOVERNOR_ID", 0.f);
+        setParameter(processor, "SATURATE_ID", 1.2f);
+        setParameter(processor, "TONE_ID", 12000.f);
+        setParameter(processor, "TAPS_ID", 3.f);
+        setParameter(processor, "FEEDBACK_ID", .5f);
+        setParameter(processor, "TAP1F_ID", 1.f);
+        setParameter(processor, "TAP2F_ID", 1.f);
+        setParameter(processor, "TAP3F_ID", 1.f);
+        setParameter(processor, "WIDTH_ID", .5f);
+        setParameter(processor, "TIME_ID", 250.f);
+        setParameter(processor, "TSPREAD_ID", 120.f);
+        setParameter(processor, "DIFFUSER_ID", .6f);
+        setParameter(processor, "MOD_ID", .5f);
+        setParameter(processor, "DAMP_ID", 9000.f);
+        setParameter(processor, "LOWCUT_ID", 80.f);
+        setParameter(processor, "DRYWET_ID", .5f);
+        setParameter(processor, "OUTPUT_ID", 1.f);
+
+        juce::MidiBuffer midi;
+        juce::AudioBuffer<float> output(input);
+        auto move = automation.begin();
+        for (int start = 0, i = 0; start < output.getNumSamples(); ++i)
+        {
+            for (; move != automation.end() && move->position <= start; ++move)
+                setParameter(processor, move->id, move->value);
+
+            auto size = varyBlockSize ? varyingBlockSizes[static_cast<size_t>(i) % varyingBlockSizes.size()] : blockSize;
+            auto length = juce::jmin(size, output.getNumSamples() - start);
+            if (move != automation.end())
+                length = juce::jmin(length, move->position - start);
+            juce::AudioBuffer<float> block(output.getArrayOfWritePointers(), output.getNumChannels(), start, length);
+            processor.processBlock(block, midi);
+            start += length;
+        }
+
+        processor.releaseResources();
+        return output;
+    }
+
+    //==========================================================================
+    // maxAbs bounds how far a render may drift from its reference. Kernels
+    // with feedback get more room, since rounding differences recirculate.
+    struct Kernel
+    {
+        const char* name;
+        std::function<juce::AudioBuffer<float>(const juce::AudioBuffer<float>&, Utils::Quality)> render;
+        float maxAbs;
+        bool tiered;
+    };
+
+    std::vector<Kernel> createKernels()
+    {
+        return {
+            { "saturate", renderSaturate, 1.0e-6f, false },
+            { "lfoBank", renderLfoBank, 1.0e-6f, false },
+            { "allpass", renderAllPass, 1.0e-5f, true },
+            { "delay", renderDelay, 1.0e-5f, true },
+            { "preamp", renderPreamp, 1.0e-5f, true },
+            { "threeTapDelay", renderThreeTapDelay, 1.0e-4f, true },
+            { "basicVerb", renderBasicVerb, 1.0e-4f, true },
+            { "fdnVerb", renderFdnVerb, 1.0e-4f, false },
+            { "processor", [] (const juce::AudioBuffer<float>& input, Utils::Quality tier) { return renderProcessor(input, tier, false); }, 1.0e-4f, true }
+        };
+    }
+
+    const char* getTierName(Utils::Quality tier)
+    {
+        switch (tier)
+        {
+            case Utils::Quality::eco:      return "eco";
+            case Utils::Quality::standard: return "standard";
+            case Utils::Quality::high:     break;
+        }
+
+        return "high";
+    }
+
+    //== References ============================================================
+    bool writeReference(const juce::File& file, const juce::AudioBuffer<float>& buffer)
+    {
+        file.deleteFile();
+        auto stream = file.createOutputStream();
+        if (stream == nullptr)
+            return false;
+
+        juce::WavAudioFormat format;
+        std::unique_ptr<juce::AudioFormatWriter> writer(format.createWriterFor(stream.get(), sampleRate,
+                                                                               static_cast<unsigned int>(buffer.getNumChannels()),
+                                                                               32, {}, 0));
+        if (writer == nullptr)
+            return false;
+
+        stream.release();
+        return writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+    }
+
+    bool readReference(const juce::File& file, juce::AudioBuffer<float>& buffer)
+    {
+        if (! file.existsAsFile())
+            return false;
+
+        juce::WavAudioFormat format;
+        std::unique_ptr<juce::AudioFormatReader> reader(format.createReaderFor(file.createInputStream().release(), true));
+        if (reader == nullptr)
+            return false;
+
+        buffer.setSize(static_cast<int>(reader->numChannels), static_cast<int>(reader->lengthInSamples));
+        return reader->read(&buffer, 0, buffer.getNumSamples(), 0, true, true);
+    }
+
+    //== Report ================================================================
+    struct Report
+    {
+        juce::Array<juce::var> results;
+        int failures{ 0 };
+
+        void add(const juce::String& name, const juce::String& kind, bool passed, const Difference& difference, float bound)
+        {
+            auto* result = new juce::DynamicObject();
+            result->setProperty("name", name);
+            result->setProperty("kind", kind);
+            result->setProperty("passed", passed);
+            result->setProperty("maxAbs", difference.maxAbs);
+            result->setProperty("relativeDb", difference.relativeDb);
+            result->setProperty("bound", bound);
+            results.add(juce::var(result));
+
+            if (! passed)
+                ++failures;
+
+            std::cerr << (passed ? "ok    " : "FAIL  ") << kind << " " << name
+                      << "  maxAbs " << difference.maxAbs << " (bound " << bound << ")"
+                      << ", error " << difference.relativeDb << " dB" << std::endl;
+        }
+
+        void addBound(const juce::String& name, const Difference& difference, float maxAbs)
+        {
+            add(name, "agreement", difference.maxAbs <= maxAbs, difference, maxAbs);
+        }
+    };
+
+    //== Agreement between exact and approximate paths ==========================
+    // Documented bounds of the FastMath kernels, with a little room for the
+    // compiler contracting multiply-adds differently.
+    template <typename Exact, typename Approximate>
+    Difference sweep(float lower, float upper, Exact&& exact, Approximate&& approximate)
+    {
+        constexpr int points = 100000;
+
+        Difference difference;
+        for (int i = 0; i < points; ++i)
+        {
+            auto x = lower + (upper - lower) * static_cast<float>(i) / static_cast<float>(points);
+            auto error = static_cast<float>(std::abs(approximate(x) - exact(x)));
+            difference.maxAbs = juce::jmax(difference.maxAbs, error);
+        }
+
+        return difference;
+    }
+
+    // Every pair of an LfoBank against std::sin at that pair's phase offset,
+    // over blocks of uneven length so renormalisation lands mid block.
+    Difference compareLfoBank()
+    {
+        constexpr int numPairs = 4, maxBlock = 97;
+        constexpr double frequency = 440.0;
+
+        Utils::LfoBank bank;
+        bank.prepare(sampleRate, maxBlock, 1, numPairs);
+        bank.setFrequency(0, static_cast<float>(frequency));
+
+        Difference difference;
+        for (int start = 0, length = 1; start < numSamples; start += length, length = length % maxBlock + 13)
+        {
+            length = juce::jmin(length, maxBlock, numSamples - start);
+            bank.process(length);
+
+            auto modulation = bank.getModulation(0);
+            for (int pair = 0; pair < numPairs; ++pair)
+            {
+                auto offset = juce::MathConstants<double>::twoPi * pair / numPairs;
+                for (int s = 0; s < length; ++s)
+                {
+                    auto phase = juce::MathConstants<double>::twoPi * frequency * (start + s) / sampleRate + offset;
+                    auto error = static_cast<float>(std::abs(modulation.forPair(pair)[s] - std::sin(phase)));
+                    difference.maxAbs = juce::jmax(difference.maxAbs, error);
+                }
+            }
+        }
+
+        return difference;
+    }
+
+    void checkApproximations(Report& report)
+    {
+        report.addBound("fastTanh ~ tanh",
+                        sweep(-12.f, 12.f, [] (float x) { return std::tanh(static_cast<double>(x)); },
+                                           [] (float x) { return static_cast<double>(Utils::fastTanh(x)); }),
+                        2.5e-6f);
+
+        report.addBound("fastSaturate ~ saturate",
+                        sweep(-4.f, 4.f, [] (float x) { return Utils::saturate(static_cast<double>(x)); },
+                                         [] (float x) { return static_cast<double>(Utils::fastSaturate(x)); }),
+                        3.0e-6f);
+
+        report.addBound("lfoBank ~ sin", compareLfoBank(), 1.0e-5f);
+
+        // Vectorised against scalar: the same arithmetic, so only rounding
+        report.addBound("fastTanh StereoFrame ~ float",
+                        sweep(-12.f, 12.f, [] (float x) { return Utils::fastTanh(x); },
+                                           [] (float x) { return Utils::fastTanh(Utils::StereoFrame::make(x, -x)).left(); }),
+                        1.0e-6f);
+
+        report.addBound("saturateBlock ~ fastSaturate",
+                        sweep(-4.f, 4.f, [] (float x) { return Utils::fastSaturate(x * 1.5f); },
+                                         [] (float x) { float y; Utils::saturateBlock(&x, &y, 1, 1.5f); return y; }),
+                        1.0e-6f);
+
+        auto noise = makeNoise();
+        juce::AudioBuffer<float> block(noise.getNumChannels(), noise.getNumSamples());
+        auto drive = 1.5f;
+
+        for (int channel = 0; channel < noise.getNumChannels(); ++channel)
+            Utils::saturateBlock(noise.getReadPointer(channel), block.getWritePointer(channel), noise.getNumSamples(), drive);
+
+        juce::AudioBuffer<float> scalar(noise);
+        for (int channel = 0; channel < scalar.getNumChannels(); ++channel)
+            for (int s = 0; s < scalar.getNumSamples(); ++s)
+                scalar.setSample(channel, s, Utils::fastSaturate(scalar.getSample(channel, s) * drive));
+
+        report.addBound("saturateBlock ~ fastSaturate, noise", compare(block, scalar), 1.0e-6f);
+    }
+
+    // A stereo pair runs in one SIMD register, a lone channel in the scalar
+    // lane; fed the same signal, both must come out the same.
+    void checkPairLayouts(Report& report)
+    {
+        auto noise = makeNoise();
+        juce::AudioBuffer<float> dualMono(2, noise.getNumSamples()), mono(1, noise.getNumSamples());
+        dualMono.copyFrom(0, 0, noise, 0, 0, noise.getNumSamples());
+        dualMono.copyFrom(1, 0, noise, 0, 0, noise.getNumSamples());
+        mono.copyFrom(0, 0, noise, 0, 0, noise.getNumSamples());
+
+        auto render = [] (const juce::AudioBuffer<float>& input) {
+            auto spec = makeSpec();
+            spec.numChannels = static_cast<juce::uint32>(input.getNumChannels());
+
+            Utils::DelayArena arena;
+            Utils::Delay delay;
+            delay.prepare(spec, sampleRate, 500.f, 0.f);
+            delay.registerDelayMemory(arena, Utils::Stage::tapsDelay);
+            arena.allocate();
+            delay.setDelayTime(120.f);
+            delay.setFeedback(.6f);
+            delay.setDamp(6000.f);
+
+            return renderInBlocks(input, [&] (juce::AudioBuffer<float>& block, const float*) {
+                delay.process(block, nullptr);
+            });
+        };
+
+        auto stereo = render(dualMono);
+        auto single = render(mono);
+
+        juce::AudioBuffer<float> right(1, stereo.getNumSamples());
+        right.copyFrom(0, 0, stereo, 1, 0, stereo.getNumSamples());
+        report.addBound("delay stereo pair ~ mono", compare(right, single), 1.0e-6f);
+    }
+
+    // Each tap recirculates through its own lane, so the taps have to sound
+    // as they would on separate lines, whichever of them have feedback on.
+    void checkTapLanes(Report& report)
+    {
+        auto noise = makeNoise();
+        const bool settings[][3] = { { true, false, false }, { false, true, true }, { true, true, true } };
+
+        for (auto tier : { Utils::Quality::eco, Utils::Quality::standard, Utils::Quality::high })
+        {
+            for (auto& feedback : settings)
+            {
+                auto taps = renderTaps(noise, tier, feedback[0], feedback[1], feedback[2]);
+                auto delays = renderTapsOnDelays(noise, tier, feedback[0], feedback[1], feedback[2]);
+
+                auto name = juce::String("threeTapDelay ") + getTierName(tier) + " ~ separate delays, feedback "
+                          + (feedback[0] ? "1" : "-") + (feedback[1] ? "2" : "-") + (feedback[2] ? "3" : "-");
+                report.addBound(name, compare(taps, delays), 1.0e-4f);
+            }
+        }
+    }
+
+    // Offline renders spread stages over worker threads; every task keeps to
+    // its own state, so the output has to be bit for bit the same.
+    void checkOfflineRender(Report& report)
+    {
+        auto noise = makeNoise();
+        auto realtime = renderProcessor(noise, Utils::Quality::high, false);
+        auto offline = renderProcessor(noise, Utils::Quality::high, true);
+        report.addBound("processor offline ~ realtime", compare(offline, realtime), 0.f);
+    }
+
+    // The chain runs in fixed sub-blocks whatever the host sends, so a
+    // render in uneven blocks has to match one in even blocks exactly.
+    void checkHostBlockSizes(Report& report)
+    {
+        auto noise = makeNoise();
+        auto even = renderProcessor(noise, Utils::Quality::high, false);
+        auto uneven = renderProcessor(noise, Utils::Quality::high, false, true);
+        report.addBound("processor uneven ~ even host blocks", compare(uneven, even), 0.f);
+    }
+
+    // Parameters are read once per sub-block, so automation on sub-block
+    // boundaries lands in the same place whatever the host's blocks. The
+    // input starts silent, so the stages go to sleep and have to wake up
+    // in the same sub-block too.
+    void checkAutomatedHostBlocks(Report& report)
+    {
+        auto input = makeNoise();
+        input.clear(0, numSamples / 2);
+
+        const std::vector<Automation> automation{
+            { 6400, "DRYWET_ID", .8f },
+            { 12800, "TIME_ID", 400.f },
+            { 19200, "TAPS_ID", 2.f },
+            { 25600, "DIFFUSER_ID", .9f },
+            { 32000, "MOD_ID", .2f },
+            { 38400, "DRYWET_ID", .3f },
+            { 44800, "TIME_ID", 150.f },
+        };
+
+        auto even = renderProcessor(input, Utils::Quality::high, false, false, automation);
+        auto uneven = renderProcessor(input, Utils::Quality::high, false, true, automation);
+        report.addBound("processor uneven ~ even host blocks, automated, from silence", compare(uneven, even), 0.f);
+    }
+
+    // Cheaper tiers trade precision, not sound: on tonal input they have to
+    // stay close to the high tier.
+    void checkTiers(Report& report)
+    {
+        auto sine = makeSine();
+        auto high = renderProcessor(sine, Utils::Quality::high, false);
+
+        for (auto tier : { Utils::Quality::eco, Utils::Quality::standard })
+        {
+            auto difference = compare(renderProcessor(sine, tier, false), high);
+            auto name = juce::String("processor ") + getTierName(tier) + " ~ high, sine";
+            report.add(name, "agreement", difference.relativeDb <= -20.f, difference, -20.f);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // The processor's parameter tree needs a message manager to exist.
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args(argc, argv);
+    auto record = args.containsOption("--record");
+    auto referenceDir = juce::File::getCurrentWorkingDirectory().getChildFile(
+        args.containsOption("--references") ? args.getValueForOption("--references") : juce::String("golden"));
+
+    if (record && ! referenceDir.createDirectory())
+    {
+        std::cerr << "Could not create " << referenceDir.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    std::vector<Input> inputs;
+    inputs.push_back({ "impulse", makeImpulse() });
+    inputs.push_back({ "noise", makeNoise() });
+    inputs.push_back({ "sine", makeSine() });
+
+    Report report;
+    int skipped = 0;
+    for (auto& kernel : createKernels())
+    {
+        auto tiers = kernel.tiered ? std::vector<Utils::Quality>{ Utils::Quality::eco, Utils::Quality::standard, Utils::Quality::high }
+                                   : std::vector<Utils::Quality>{ Utils::Quality::high };
+
+        for (auto tier : tiers)
+        {
+            for (auto& input : inputs)
+            {
+                auto name = juce::String(kernel.name) + "_" + getTierName(tier) + "_" + input.name;
+                auto file = referenceDir.getChildFile(name + ".wav");
+                if (! record && ! file.existsAsFile())
+                {
+                    ++skipped;
+                    continue;
+                }
+
+                auto output = kernel.render(input.buffer, tier);
+
+                if (record)
+                {
+                    if (! writeReference(file, output))
+                    {
+                        std::cerr << "Could not write " << file.getFullPathName() << std::endl;
+                        return 1;
+                    }
+
+                    std::cerr << "Recorded " << name << std::endl;
+                    continue;
+                }
+
+                juce::AudioBuffer<float> reference;
+                if (! readReference(file, reference))
+                {
+                    std::cerr << "Could not read " << file.getFullPathName() << std::endl;
+                    return 1;
+                }
+
+                auto difference = compare(output, reference);
+                report.add(name, "golden", difference.maxAbs <= kernel.maxAbs, difference, kernel.maxAbs);
+            }
+        }
+    }
+
+    if (record)
+        return 0;
+
+    if (skipped > 0)
+        std::cerr << "Skipped " << skipped << " golden comparisons with no reference in "
+                  << referenceDir.getFullPathName() << ", record them with --record" << std::endl;
+
+    checkApproximations(report);
+    checkPairLayouts(report);
+    checkTapLanes(report);
+    checkOfflineRender(report);
+    checkHostBlockSizes(report);
+    checkAutomatedHostBlocks(report);
+    checkTiers(report);
+
+    juce::var summary(new juce::DynamicObject());
+    summary.getDynamicObject()->setProperty("plugin", "TapDancer");
+    summary.getDynamicObject()->setProperty("references", referenceDir.getFullPathName());
+    summary.getDynamicObject()->setProperty("failures", report.failures);
+    summary.getDynamicObject()->setProperty("skipped", skipped);
+    summary.getDynamicObject()->setProperty("results", report.results);
+
+    if (args.containsOption("--output"))
+    {
+        auto outputFile = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--output"));
+        if (! outputFile.replaceWithText(juce::JSON::toString(summary)))
+        {
+            std::cerr << "Could not write " << outputFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cerr << report.failures << " of " << report.results.size() << " checks failed" << std::endl;
+    return report.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+#include "TapDancer/PluginProcessor.h"
+#include "Utils/RealtimeSafety.h"
+#include "Utils/StageProfiler.h"
+
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include <iostream>
+
+//==============================================================================
+// Headless render benchmark. Builds the processor without a host, renders a
+// synthetic signal through prepareToPlay/processBlock for every combination of
+// sample rate, block size and preset, and prints the results as JSON.
+//
+// Usage:
+//   TapDancerBenchmark [--rates=44100,48000] [--blocks=64,512] [--seconds=1]
+//                      [--quality=0|1|2] [--fdn] [--offline] [--layout=stereo]
+//                      [--downsample] [--output=results.json]
+//
+// --fdn runs the diffuser presets through the FdnVerb instead of the two
+// BasicVerb stages.
+//
+// --layout picks the bus: mono, stereo, 5.1, 7.1 or 7.1.4. Cost and delay
+// memory per channel should stay flat from one layout to the next.
+//
+// --downsample runs the wet path at 44.1 or 48 kHz at the higher rates.
+//
+// --offline renders the way a host bounce does, with the processor told it is
+// not running in real time, so independent stages spread over worker threads.
+//==============================================================================
+namespace
+{
+    struct Preset
+    {
+        float taps;
+        bool diffuser, modulation;
+
+        juce::String getName() const
+        {
+            return "taps" + juce::String(static_cast<int>(taps))
+                 + (diffuser ? "_diffuser" : "")
+                 + (modulation ? "_mod" : "");
+        }
+    };
+
+    struct Settings
+    {
+        juce::Array<double> sampleRates{ 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0 };
+        juce::Array<int> blockSizes{ 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
+        double renderSeconds{ 1.0 }, warmUpSeconds{ 0.25 };
+        int quality{ 1 };
+        bool fdn{ false };
+        bool offline{ false };
+        bool downsample{ false };
+        juce::String layout{ "stereo" };
+        juce::File outputFile;
+    };
+
+    juce::AudioChannelSet getChannelSet(const juce::String& layout)
+    {
+        if (layout == "mono")   return juce::AudioChannelSet::mono();
+        if (layout == "5.1")    return juce::AudioChannelSet::create5point1();
+        if (layout == "7.1")    return juce::AudioChannelSet::create7point1();
+        if (layout == "7.1.4")  return juce::AudioChannelSet::create7point1point4();
+
+        return juce::AudioChannelSet::stereo();
+    }
+
+    juce::Array<Preset> createPresets()
+    {
+        juce::Array<Preset> presets;
+        for (int taps = 0; taps <= 3; ++taps)
+            for (auto diffuser : { false, true })
+                for (auto modulation : { false, true })
+                    presets.add({ static_cast<float>(taps), diffuser, modulation });
+
+        return presets;
+    }
+
+    void setParameter(AudioPluginAudioProcessor& processor, const juce::String& id, float value)
+    {
+        if (auto* param = processor.treeState.getParameter(id))
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+    }
+
+    void applyPreset(AudioPluginAudioProcessor& processor, const Preset& preset, const Settings& settings)
+    {
+        setParameter(processor, "QUALITY_ID", static_cast<float>(settings.quality));
+        setParameter(processor, "DIFFUSER_TYPE_ID", settings.fdn ? 1.f : 0.f);
+        setParameter(processor, "GOVERNOR_ID", 0.f);
+        setParameter(processor, "SATURATE_ID", 1.2f);
+        setParameter(processor, "TONE_ID", 12000.f);
+        setParameter(processor, "TAPS_ID", preset.taps);
+        setParameter(processor, "FEEDBACK_ID", .5f);
+        setParameter(processor, "TAP1F_ID", 1.f);
+        setParameter(processor, "TAP2F_ID", 1.f);
+        setParameter(processor, "TAP3F_ID", 1.f);
+        setParameter(processor, "WIDTH_ID", .5f);
+        setParameter(processor, "TIME_ID", 250.f);
+        setParameter(processor, "TSPREAD_ID", 120.f);
+        setParameter(processor, "DIFFUSER_ID", preset.diffuser ? .6f : 0.f);
+        setParameter(processor, "MOD_ID", preset.modulation ? .5f : 0.f);
+        setParameter(processor, "DAMP_ID", 9000.f);
+        setParameter(processor, "LOWCUT_ID", 80.f);
+        setParameter(processor, "DRYWET_ID", .5f);
+        setParameter(processor, "OUTPUT_ID", 1.f);
+    }
+
+    // Fills the buffer with a 220 Hz tone plus a little noise, so
+    // every stage sees non trivial, non denormal input.
+    void fillSignal(juce::AudioBuffer<float>& buffer, juce::Random& random, double& phase, double phaseDelta)
+    {
+        for (int s = 0; s < buffer.getNumSamples(); ++s)
+        {
+            auto tone = static_cast<float>(std::sin(phase)) * .5f;
+            phase = std::fmod(phase + phaseDelta, juce::MathConstants<double>::twoPi);
+
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+                buffer.setSample(channel, s, tone + (random.nextFloat() - .5f) * .1f);
+        }
+    }
+
+    juce::var runCase(double sampleRate, int blockSize, const Preset& preset, const Settings& settings)
+    {
+        AudioPluginAudioProcessor processor;
+        Utils::StageProfiler profiler;
+
+        auto channelSet = getChannelSet(settings.layout);
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(channelSet);
+        layout.outputBuses.add(channelSet);
+        if (! processor.setBusesLayout(layout))
+            std::cerr << "Layout " << settings.layout << " is not supported" << std::endl;
+
+        processor.setNonRealtime(settings.offline);
+        processor.setWetDownsampling(settings.downsample);
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+        applyPreset(processor, preset, settings);
+
+        juce::AudioBuffer<float> buffer(processor.getTotalNumOutputChannels(), blockSize);
+        juce::MidiBuffer midi;
+        juce::Random random(1234);
+        double phase = 0.0, phaseDelta = juce::MathConstants<double>::twoPi * 220.0 / sampleRate;
+
+        auto warmUpBlocks = juce::jmax(1, static_cast<int>(settings.warmUpSeconds * sampleRate) / blockSize);
+        auto renderBlocks = juce::jmax(1, static_cast<int>(settings.renderSeconds * sampleRate) / blockSize);
+
+        for (int b = 0; b < warmUpBlocks; ++b)
+        {
+            fillSignal(buffer, random, phase, phaseDelta);
+            processor.processBlock(buffer, midi);
+        }
+
+        processor.setStageProfiler(&profiler);
+
+        juce::int64 processTicks = 0;
+        for (int b = 0; b < renderBlocks; ++b)
+        {
+            fillSignal(buffer, random, phase, phaseDelta);
+
+            auto start = juce::Time::getHighResolutionTicks();
+            processor.processBlock(buffer, midi);
+            processTicks += juce::Time::getHighResolutionTicks() - start;
+        }
+
+        processor.setStageProfiler(nullptr);
+        processor.releaseResources();
+
+        auto numSamples = static_cast<double>(profiler.getNumSamples());
+        auto cpuSeconds = juce::Time::highResolutionTicksToSeconds(processTicks);
+        auto audioSeconds = numSamples / sampleRate;
+
+        auto& delayArena = processor.getDelayArena();
+        auto* stages = new juce::DynamicObject();
+        for (int i = 0; i < Utils::StageProfiler::numStages; ++i)
+        {
+            auto stage = static_cast<Utils::Stage>(i);
+            auto stageSeconds = profiler.getStageSeconds(stage);
+
+            auto* stageResult = new juce::DynamicObject();
+            stageResult->setProperty("nsPerSample", stageSeconds * 1.0e9 / numSamples);
+            stageResult->setProperty("share", profiler.getTotalSeconds() > 0.0 ? stageSeconds / profiler.getTotalSeconds() : 0.0);
+            stageResult->setProperty("delayBytes", static_cast<juce::int64>(delayArena.getBytes(stage)));
+            stages->setProperty(Utils::getStageName(stage), juce::var(stageResult));
+        }
+
+        auto* result = new juce::DynamicObject();
+        result->setProperty("preset", preset.getName());
+        result->setProperty("taps", preset.taps);
+        result->setProperty("diffuser", preset.diffuser);
+        result->setProperty("modulation", preset.modulation);
+        result->setProperty("sampleRate", sampleRate);
+        result->setProperty("blockSize", blockSize);
+        result->setProperty("channels", processor.getTotalNumOutputChannels());
+        result->setProperty("samples", static_cast<juce::int64>(numSamples));
+        result->setProperty("nsPerSample", cpuSeconds * 1.0e9 / numSamples);
+        // Processing time over audio time: 1.0 means one instance uses a whole core.
+        result->setProperty("realTimeFactor", cpuSeconds / audioSeconds);
+        result->setProperty("delayBytes", static_cast<juce::int64>(delayArena.getTotalBytes()));
+        result->setProperty("stages", juce::var(stages));
+
+        return juce::var(result);
+    }
+
+    template <typename ValueType>
+    juce::Array<ValueType> parseList(const juce::String& text)
+    {
+        juce::Array<ValueType> values;
+        for (auto& token : juce::StringArray::fromTokens(text, ",", ""))
+        {
+            if constexpr (std::is_same_v<ValueType, int>)
+                values.add(token.getIntValue());
+            else
+                values.add(static_cast<ValueType>(token.getDoubleValue()));
+        }
+
+        return values;
+    }
+
+    Settings parseSettings(const juce::ArgumentList& args)
+    {
+        Settings settings;
+
+        if (args.containsOption("--rates"))
+            settings.sampleRates = parseList<double>(args.getValueForOption("--rates"));
+
+        if (args.containsOption("--blocks"))
+            settings.blockSizes = parseList<int>(args.getValueForOption("--blocks"));
+
+        if (args.containsOption("--seconds"))
+            settings.renderSeconds = juce::jmax(.01, args.getValueForOption("--seconds").getDoubleValue());
+
+        if (args.containsOption("--quality"))
+            settings.quality = juce::jlimit(0, Utils::numQualityTiers - 1, args.getValueForOption("--quality").getIntValue());
+
+        settings.fdn = args.containsOption("--fdn");
+        settings.offline = args.containsOption("--offline");
+        settings.downsample = args.containsOption("--downsample");
+
+        if (args.containsOption("--layout"))
+            settings.layout = args.getValueForOption("--layout");
+
+        if (args.containsOption("--output"))
+            settings.outputFile = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--output"));
+
+        return settings;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // The processor's parameter tree needs a message manager to exist.
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args(argc, argv);
+    auto settings = parseSettings(args);
+    auto presets = createPresets();
+
+    juce::Array<juce::var> results;
+    for (auto sampleRate : settings.sampleRates)
+    {
+        for (auto blockSize : settings.blockSizes)
+        {
+            for (auto& preset : presets)
+            {
+                std::cerr << "Rendering " << preset.getName() << " @ " << sampleRate
+                          << " Hz, " << blockSize << " samples" << std::endl;
+                results.add(runCase(sampleRate, blockSize, preset, settings));
+            }
+        }
+    }
+
+    auto* report = new juce::DynamicObject();
+    report->setProperty("plugin", "TapDancer");
+    report->setProperty("cpu", juce::SystemStats::getCpuModel());
+    report->setProperty("renderSeconds", settings.renderSeconds);
+    report->setProperty("quality", settings.quality);
+    report->setProperty("diffuser", settings.fdn ? "fdn" : "allpass");
+    report->setProperty("offline", settings.offline);
+    report->setProperty("layout", settings.layout);
+    report->setProperty("downsample", settings.downsample);
+    report->setProperty("realtimeViolations", Utils::getRealtimeViolationCount());
+    report->setProperty("results", results);
+
+    auto json = juce::JSON::toString(juce::var(report));
+
+    if (settings.outputFile != juce::File())
+    {
+        if (! settings.outputFile.replaceWithText(json))
+        {
+            std::cerr << "Could not write " << settings.outputFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout << json << std::endl;
+    }
+
+    return 0;
+}